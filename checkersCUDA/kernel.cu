@@ -1,17 +1,41 @@
 ﻿
+// file is also built by host compiler without device, then all players run simulations on host
+#ifdef __CUDACC__
 #include "cuda_runtime.h"
 #include "device_launch_parameters.h"
+#include <thrust/device_ptr.h>
+#include <thrust/reduce.h>
+#include <curand_kernel.h>
+#else
+#include <cmath>
+#include <cstring>
+#define __host__
+#define __device__
+#endif
 
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
 #include <time.h>
 #include <chrono>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <climits>
+#include <cfloat>
+#include <algorithm>
 #include <SFML/Graphics.hpp>
 #include <SFML/Window.hpp>
-#include <thrust/device_ptr.h>
-#include <thrust/reduce.h>
-#include <curand_kernel.h>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 800
@@ -21,6 +45,25 @@
 
 #define MAX_MOVES 50
 
+// collects rollout length, termination reason and captures statistics, compiled out when disabled
+#define ROLLOUT_STATS false
+
+#define ROLLOUT_END_WIN 0
+#define ROLLOUT_END_NO_MOVES 1
+#define ROLLOUT_END_MAX_MOVES 2
+#define ROLLOUT_END_ADJUDICATION 3
+#define ROLLOUT_END_REASONS 4
+
+// rollout is adjudicated as draw when position repeats within last REPETITION_HISTORY reversible plies
+// or when no pawn was killed and no non queen pawn moved for NO_PROGRESS_LIMIT plies
+#define ROLLOUT_DRAW_DETECTION true
+#define REPETITION_HISTORY 8
+#define NO_PROGRESS_LIMIT 20
+
+// rollout stopped by MAX_MOVES is continued with kills only, while side to move has one, up to QUIESCENCE_MAX_PLIES plies
+#define ROLLOUT_QUIESCENCE true
+#define QUIESCENCE_MAX_PLIES 8
+
 
 #define QUEEN_VALUE 80
 #define PAWN_VALUE 30
@@ -37,16 +80,155 @@
 
 // this should be multiply of 1024 otherwise it will get ceiled up to nearest multiplication of 1024
 #define NUM_OF_EVAL_ONE 10240
+#define EVAL_BATCH_ONE 1024
 #define TREE_ITER_ONE 50
+// search also stops once move takes MOVE_TIME_ONE milliseconds or adds MAX_NODES_ONE nodes to tree
+// or runs MAX_SIMULATIONS_ONE simulations, whichever comes first, 0 disables limit (TREE_ITER_ONE too)
+#define MOVE_TIME_ONE 0
+#define MAX_NODES_ONE 0
+#define MAX_SIMULATIONS_ONE 0
+#if TREE_ITER_ONE == 0 && MOVE_TIME_ONE == 0 && MAX_NODES_ONE == 0 && MAX_SIMULATIONS_ONE == 0
+#error "search of player one needs at least one limit"
+#endif
 #define PARALLEL_PLAYER_ONE false
 
 // this should be multiply of 1024 otherwise it will get ceiled up to nearest multiplication of 1024
 #define NUM_OF_EVAL_TWO 102400
+#define EVAL_BATCH_TWO 10240
 #define TREE_ITER_TWO 50
+// search also stops once move takes MOVE_TIME_TWO milliseconds or adds MAX_NODES_TWO nodes to tree
+// or runs MAX_SIMULATIONS_TWO simulations, whichever comes first, 0 disables limit (TREE_ITER_TWO too)
+#define MOVE_TIME_TWO 0
+#define MAX_NODES_TWO 0
+#define MAX_SIMULATIONS_TWO 0
+#if TREE_ITER_TWO == 0 && MOVE_TIME_TWO == 0 && MAX_NODES_TWO == 0 && MAX_SIMULATIONS_TWO == 0
+#error "search of player two needs at least one limit"
+#endif
 #define PARALLEL_PLAYER_TWO true
 
+// when enabled leaf is evaluated in batches of EVAL_BATCH_* simulations (up to NUM_OF_EVAL_*)
+// and evaluation stops once confidence interval of mean reward is narrow enough
+// or it doesn't contain best reward among already evaluated siblings
+#define ADAPTIVE_EVAL true
+#define EVAL_CONFIDENCE_Z 1.96f
+#define EVAL_CI_HALF_WIDTH 4.0f
+
+// leaf evaluation results are cached by position hash and reused (or topped up) when position is reached again
+// size should be power of 2
+#define EVAL_CACHE true
+#define EVAL_CACHE_SIZE (1 << 16)
+#define EVAL_CACHE_LOCKS 64
+
 #define MAX_BLOCK 1024
 
+// nodes of MCTS tree are allocated in chunks of ARENA_CHUNK_SIZE nodes
+#define ARENA_CHUNK_SHIFT 12
+#define ARENA_CHUNK_SIZE (1 << ARENA_CHUNK_SHIFT)
+#define ARENA_MAX_CHUNKS 4096
+// upper bound of moves available in single position
+#define MAX_CHILDREN 160
+#define NODE_OFFSET(idx) ((idx) & (ARENA_CHUNK_SIZE - 1))
+
+// flags of MCTS tree node
+#define NODE_BLACK_TURN 1
+#define NODE_CHAIN_KILL 2
+// rewards of node are kept from perspective of black player
+#define NODE_BLACK_MOVED 4
+// children of node are children of other node with equal game state
+#define NODE_LINKED 8
+// node is claimed for expansion by one of threads
+#define NODE_EXPANDING 16
+// children of node are initialized, node without them is end of game
+#define NODE_EXPANDED 32
+// node is on principal variation or current path and its subtree can't be recycled
+#define NODE_KEEP 64
+// proven result of game from perspective of player who moved into node
+#define NODE_WIN 128
+#define NODE_LOSS 256
+#define NODE_DRAW 512
+#define NODE_SOLVED (NODE_WIN | NODE_LOSS | NODE_DRAW)
+// flags of move leading to node
+#define MOVE_KILL 1
+#define MOVE_CHANGE_TURN 2
+// game state of node is kept in arena once node is visited this many times
+#define POSITION_CACHE_VISITS 8
+// nodes with equal game state share children, found through table of expanded nodes
+#define TRANSPOSITIONS false
+#define TRANSPOSITION_TABLE_SIZE (1 << 16)
+// chunks of nodes and game states of all arenas of player's tree take at most this many bytes, 0 means no limit,
+// arenas keep their chunks after reset so spare arena and root parallel workers count with main one,
+// once limit is hit tree grown by single thread without transpositions releases least visited subtrees
+// off principal variation until TREE_RECYCLE_SHARE of nodes under root is freed, other trees stop expanding,
+// replies other than one played are released on reuse of such tree and kept until compaction by others
+#define TREE_MEMORY_LIMIT (1LL << 30)
+#define TREE_RECYCLE true
+#define TREE_RECYCLE_SHARE 0.25f
+// descent stops at this depth even if node has children
+#define MAX_TREE_DEPTH 1024
+// walks of subtrees released by recycling keep at most children of every node on single path
+#define RECYCLE_STACK_SIZE ((MAX_TREE_DEPTH + 1) * MAX_CHILDREN)
+// number of independent trees grown by threads of player without device evaluation,
+// their root statistics are merged before move is chosen, 0 uses all cores
+#define ROOT_PARALLEL_THREADS 1
+// number of threads growing main tree of player without device evaluation, 0 uses all cores,
+// each of them adds VIRTUAL_LOSS visits with VIRTUAL_LOSS_REWARD lost to nodes on its path until simulation ends
+#define TREE_PARALLEL_THREADS 1
+#define VIRTUAL_LOSS 1
+#define VIRTUAL_LOSS_REWARD 50.0f
+// first iterations of tree parallel search, at most quarter of its budget, are run by single thread
+// so that iteration rate of all threads afterwards can be compared with its rate
+#define PARALLEL_CALIBRATION_ITERATIONS 64
+// player keeps growing tree from position after its move until its next search, up to PONDER_MAX_NODES new nodes,
+// visits of reused subtree grown that way count towards iterations of next search
+#define PONDER true
+#define PONDER_MAX_NODES (1 << 20)
+// tree of engine which moved last is saved to TREE_SNAPSHOT_FILE when window is closed right after its move,
+// file is removed on any other exit, game and pondering are resumed from it on start,
+// file is mapped to memory as it is so loading doesn't depend on size of tree
+#define TREE_SNAPSHOT false
+#define TREE_SNAPSHOT_FILE "tree.snapshot"
+#define SNAPSHOT_VERSION 1
+// chunks in snapshot file start at this offset so that they are aligned to memory pages
+#define SNAPSHOT_ALIGNMENT 4096
+// upper confidence boundaries of children are calculated four at once with SSE
+#define UCB_SIMD true
+#if UCB_SIMD
+#include <xmmintrin.h>
+#endif
+// nodes without moves are solved and proven results are propagated up the tree, solved nodes aren't simulated
+// but back up SOLVED_REWARD (nothing for draw), children lost for player to move are never selected
+// and search ends once root is solved, root parallel workers included,
+// position without moves is draw unless player to move has no pawns
+#define MCTS_SOLVER true
+// exceeds any value of evaluatePositionValue, material term is at most square of material of all queens
+// and positional terms of all pawns are below material of all queens
+#define MAX_MATERIAL_VALUE (PAWN_ROWS * BOARD_SIZE / 2 * QUEEN_VALUE)
+#define SOLVED_REWARD ((float)MAX_MATERIAL_VALUE * (MAX_MATERIAL_VALUE + 1))
+// children keep all-moves-as-first statistics of their move played later on the path or in simulations of leaf,
+// average reward used by selection is blended with them by sqrt(RAVE_EQUIVALENCE / (3 * visits + RAVE_EQUIVALENCE)),
+// their two floats take node past 32 bytes, fractional shares of visits don't fit narrower type
+#define RAVE false
+#define RAVE_EQUIVALENCE 100.0f
+// move is identified by pawn and field it moves to
+#define AMAF_KEYS (PAWN_ROWS * BOARD_SIZE * BOARD_SIZE * BOARD_SIZE)
+#define AMAF_WORDS (AMAF_KEYS / 32)
+// children are ordered by evaluatePositionValue of game state after their move at expansion and only
+// first PW_COEFFICIENT * visits ^ PW_EXPONENT of them (at least one, lost ones not counted) can be selected
+#define PROGRESSIVE_WIDENING true
+#define PW_COEFFICIENT 2.0f
+#define PW_EXPONENT 0.5f
+// children are selected by average reward + PUCT_CONSTANT * prior * sqrt(parentVisits) / (1 + visits) instead of UCB,
+// priors are given once at expansion by PUCT_PRIORS, by default softmax over evaluatePositionValue after move
+// divided by PUCT_TEMPERATURE, children without visits are valued as their parent,
+// PUCT_CONSTANT is in units of rewards which after rollouts reach thousands, RAVE statistics aren't blended in so both can't be on
+#define PUCT false
+#define PUCT_CONSTANT 10000.0f
+#define PUCT_TEMPERATURE 10.0f
+#define PUCT_PRIORS getEvaluationPriors
+#if PUCT && RAVE
+#error "PUCT selection doesn't use RAVE statistics, turn one of them off"
+#endif
+
 #define BLOCK_SIZE_ONE (NUM_OF_EVAL_ONE < MAX_BLOCK ? NUM_OF_EVAL_ONE : MAX_BLOCK)
 #define BLOCK_SIZE_TWO (NUM_OF_EVAL_TWO < MAX_BLOCK ? NUM_OF_EVAL_TWO : MAX_BLOCK)
 
@@ -61,25 +243,247 @@
 #define BLOCK_NUM_ONE_V dim3((NUM_OF_EVAL_ONE / (float)BLOCK_SIZE_ONE != NUM_OF_EVAL_ONE / BLOCK_SIZE_ONE ? NUM_OF_EVAL_ONE / BLOCK_SIZE_ONE + 1 : NUM_OF_EVAL_ONE / BLOCK_SIZE_ONE), 1, 1)
 #define BLOCK_NUM_TWO_V dim3((NUM_OF_EVAL_TWO / (float)BLOCK_SIZE_TWO != NUM_OF_EVAL_TWO / BLOCK_SIZE_TWO ? NUM_OF_EVAL_TWO / BLOCK_SIZE_TWO + 1 : NUM_OF_EVAL_TWO / BLOCK_SIZE_TWO), 1, 1)
 
+#ifdef __CUDACC__
 __shared__ volatile float sumRewards[MAX_BLOCK];
+#endif
 
 using namespace sf;
 using namespace std;
 
+// game state of node of MCTS tree, read only on expansion and evaluation
 typedef struct node {
-    int* rows;
-    int* cols;
-    int* fields;
-    bool* isQueen;
+    int rows[PAWN_ROWS * BOARD_SIZE];
+    int cols[PAWN_ROWS * BOARD_SIZE];
+    int fields[BOARD_SIZE * BOARD_SIZE];
+    bool isQueen[PAWN_ROWS * BOARD_SIZE];
     bool blackTurn;
     int lastKill;
-    int childSize;
-    node** childs;
-    node* parent;
-    float avgReward;
-    int howManyVisits;
 } node;
 
+// game state kept in arena with bytes in place of ints
+typedef struct packedPosition {
+    signed char fields[BOARD_SIZE * BOARD_SIZE];
+    signed char rows[PAWN_ROWS * BOARD_SIZE];
+    signed char cols[PAWN_ROWS * BOARD_SIZE];
+    // bit of every pawn which is queen, next released game state is kept here
+    unsigned int queens;
+    bool blackTurn;
+    signed char lastKill;
+} packedPosition;
+
+// move of single pawn leading from parent to node
+typedef struct edgeMove {
+    unsigned char pawn;
+    unsigned char row;
+    unsigned char col;
+    unsigned char flags;
+} edgeMove;
+
+// moves available in game state, collected before children are allocated
+typedef struct moveList {
+    edgeMove moves[MAX_CHILDREN];
+    int size;
+} moveList;
+
+// chunk of arena, statistics used by selection are kept in separate arrays
+// so that scanning siblings does not touch game states,
+// fields changed during search are atomic so that threads can share tree
+typedef struct nodeChunk {
+    std::atomic<int> visits[ARENA_CHUNK_SIZE];
+    // sum of rewards of simulations passing through node from perspective of player who moved into it
+    std::atomic<float> rewardSum[ARENA_CHUNK_SIZE];
+    // children are stored next to each other starting from this index
+    int firstChild[ARENA_CHUNK_SIZE];
+    // set once children are initialized, there are at most MAX_CHILDREN of them
+    std::atomic<unsigned char> childSize[ARENA_CHUNK_SIZE];
+    int parent[ARENA_CHUNK_SIZE];
+    std::atomic<unsigned short> flags[ARENA_CHUNK_SIZE];
+    edgeMove move[ARENA_CHUNK_SIZE];
+    // index of game state kept in arena or -1 if it has to be built from parent
+    std::atomic<int> position[ARENA_CHUNK_SIZE];
+#if PUCT
+    // probability of move leading to node given by prior provider
+    float prior[ARENA_CHUNK_SIZE];
+#endif
+#if RAVE
+    // all-moves-as-first statistics of move leading to node, rollouts count by share of simulations of leaf
+    std::atomic<float> amafVisits[ARENA_CHUNK_SIZE];
+    std::atomic<float> amafRewardSum[ARENA_CHUNK_SIZE];
+#endif
+} nodeChunk;
+#if !RAVE
+static_assert(sizeof(nodeChunk) <= 32 * ARENA_CHUNK_SIZE, "node of arena takes more than 32 bytes");
+#endif
+
+// expanded node of MCTS tree with given game state hash
+typedef struct transpositionEntry {
+    unsigned long long hash;
+    int idx;
+    int generation;
+} transpositionEntry;
+
+// bytes of chunks allocated by all arenas of single tree, reserved before chunk is allocated
+typedef struct memoryBudget {
+    std::atomic<long long> bytes;
+    std::atomic<long long> peakBytes;
+} memoryBudget;
+
+// chunked pool of nodes of single search, nodes refer to each other by indices
+// and chunks are never moved so pointers to nodes stay valid,
+// nodes and chunks are allocated without locks
+typedef struct nodeArena {
+    std::atomic<nodeChunk*> chunks[ARENA_MAX_CHUNKS];
+    std::atomic<int> numOfChunks;
+    std::atomic<int> size;
+    std::atomic<packedPosition*> positionChunks[ARENA_MAX_CHUNKS];
+    std::atomic<int> numOfPositionChunks;
+    std::atomic<int> numOfPositions;
+    transpositionEntry* transpositions;
+    // entries stored before last reset have older generation
+    int generation;
+    // released blocks of children by their size, next block of same size is kept in firstChild of first node,
+    // only tree grown by single thread releases nodes
+    int freeBlocks[MAX_CHILDREN + 1];
+    int freeNodes;
+    // released game states, next one is kept in their queens
+    int freePosition;
+    int freePositions;
+    // snapshot file mapped to memory which chunks of arena can point into
+    char* snapshot;
+    long long snapshotBytes;
+    // budget shared with other arenas of same tree
+    memoryBudget* memory;
+    // stacks of walks releasing nodes, allocated with arena so that recycling at memory limit doesn't allocate
+    int* recycleStack;
+    int* recycleBlocks;
+} nodeArena;
+
+// statistics of simulations played out from leaves, made only of counters which device sums per block as array
+typedef struct rolloutStats {
+    unsigned long long rollouts;
+    unsigned long long plies;
+    unsigned long long captures;
+    unsigned long long endReasons[ROLLOUT_END_REASONS];
+    unsigned long long lengthHistogram[MAX_MOVES + 1];
+} rolloutStats;
+
+// moves played by simulations of single leaf evaluation by their key, rewards are kept from evaluating player perspective
+typedef struct amafStats {
+    float rewardSum[AMAF_KEYS];
+    unsigned int visits[AMAF_KEYS];
+    int numOfRollouts;
+} amafStats;
+
+// statistics of single AI move
+typedef struct searchStats {
+    long long simulations;
+    long long simulationsSaved;
+    long long cacheHits;
+    long long simulationsReused;
+    // visits of root taken over from previous search
+    long long visitsReused;
+    long long transpositionsLinked;
+    // share of wall time of search threads spent in simulations, doesn't tell speedup over single thread
+    double threadUtilization;
+    // iterations per second of tree parallel search over number of threads times rate of its single thread start,
+    // counts lost work of contention and virtual loss but later iterations can be costlier, 0 with single thread
+    double parallelEfficiency;
+    // bytes of nodes and game states in use by tree after search
+    long long treeBytes;
+    // most bytes of chunks allocated by all arenas of tree so far
+    long long peakTreeBytes;
+    long long nodesRecycled;
+    long long nodesSolved;
+    // iterations run and wall time of search in microseconds
+    long long iterations;
+    // iterations run on opponent's time before search
+    long long iterationsPondered;
+    long long searchTime;
+    rolloutStats rollouts;
+} searchStats;
+
+// limits of single search shared by threads growing same tree
+typedef struct searchBudget {
+    std::atomic<int> iterations;
+    std::atomic<long long> simulations;
+    std::atomic<bool> stopped;
+    bool hasDeadline;
+    std::chrono::high_resolution_clock::time_point deadline;
+    int nodesStart;
+    int maxNodes;
+    long long maxSimulations;
+    // set once root of search is solved, budget of root parallel worker is stopped by solved root of main tree
+    std::atomic<bool> solved;
+    struct searchBudget* shared;
+} searchBudget;
+
+// MCTS tree of single player kept between its moves
+typedef struct searchTree {
+    nodeArena* arena;
+    // arena that subtree of last move is compacted into once move is made
+    nodeArena* spare;
+    // node reached by last move of player or -1 if tree can't be reused
+    int lastMove;
+    // arenas of independent trees grown next to main one by root parallel search
+    nodeArena** workers;
+    int numOfWorkers;
+    // compaction of tree to subtree of lastMove and search growing it on opponent's time
+    std::thread backgroundThread;
+    searchBudget ponderBudget;
+    searchStats ponderStats;
+    // root of pondering or -1 and visits of its children once it started
+    int ponderRoot;
+    int ponderStartVisits[MAX_CHILDREN];
+    // visits root of search got on opponent's time, visits of previous search aren't counted
+    int visitsPondered;
+    memoryBudget memory;
+} searchTree;
+
+// start of snapshot file, followed by node chunks and chunks of game states of tree at SNAPSHOT_ALIGNMENT,
+// chunks are written whole so that they keep their layout in memory
+typedef struct snapshotHeader {
+    char magic[8];
+    int version;
+    // layout of chunks, snapshot of differently configured build can't be loaded
+    int chunkSize;
+    int nodeChunkBytes;
+    int positionBytes;
+    int player;
+    int lastMove;
+    int size;
+    int numOfPositions;
+    int freeBlocks[MAX_CHILDREN + 1];
+    int freeNodes;
+    int freePosition;
+    int freePositions;
+} snapshotHeader;
+static_assert(sizeof(snapshotHeader) <= SNAPSHOT_ALIGNMENT, "snapshot header must fit before first chunk");
+
+// cached simulations result of position, rewards are kept from black perspective,
+// players run different number of simulations so each of them has its own entries
+typedef struct evalCacheEntry {
+    unsigned long long hash;
+    int player;
+    double sumRewards;
+    double sumSquaredRewards;
+    int numOfEvaluations;
+} evalCacheEntry;
+
+// bounded cache of evaluations shared between moves of the game
+typedef struct evalCache {
+    evalCacheEntry* entries;
+    std::mutex* locks;
+} evalCache;
+
+// recent positions of rollout used to detect repetitions and lack of progress
+typedef struct drawTracker {
+    unsigned long long history[REPETITION_HISTORY];
+    int historySize;
+    int historyPos;
+    int progressKey;
+    int noProgressPlies;
+} drawTracker;
+
 typedef struct fixedNode {
     int rows[PAWN_ROWS * BOARD_SIZE];
     int cols[PAWN_ROWS * BOARD_SIZE];
@@ -277,6 +681,19 @@ __host__ __device__ bool hasKill(int* fields, int idx, int* rows, int* cols, boo
     return false;
 }
 
+// determines if any pawn of player has kill
+__host__ __device__ bool hasAnyKill(int* fields, int* rows, int* cols, bool* isQueen, bool blackTurn)
+{
+    int start = blackTurn ? PAWN_ROWS * BOARD_SIZE / 2 : 0;
+    int end = blackTurn ? PAWN_ROWS * BOARD_SIZE : PAWN_ROWS * BOARD_SIZE / 2;
+    for (int i = start; i < end; i++)
+    {
+        if (rows[i] >= 0 && (isQueen[i] ? hasQueenKill(fields, rows[i], cols[i], i) : hasKill(fields, i, rows, cols)))
+            return true;
+    }
+    return false;
+}
+
 // sets positions that pawn can move to in available data structure
 __host__ __device__ void setAvailableFields(int row, int col, bool isWhite, bool* available, int* fields, int& numOfAvailable)
 {
@@ -461,7 +878,7 @@ __host__ void markAvailableFields(RectangleShape* fieldShapes, bool* available)
     for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
     {
         if (available[i])
-            fieldShapes[i].setFillColor(Color::Color(125, 125, 125));
+            fieldShapes[i].setFillColor(Color(125, 125, 125));
     }
 }
 
@@ -531,20 +948,82 @@ __host__ __device__ int trackPawnToRemove(int rowStart, int colStart, int rowEnd
     return -1;
 }
 
+// mixes bits of value, used to derive zobrist keys without lookup table
+__host__ __device__ unsigned long long mixHash(unsigned long long x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// zobrist key of pawn standing on field
+__host__ __device__ unsigned long long getPawnKey(int field, int idx, bool isQueen)
+{
+    int pawnType = (idx < PAWN_ROWS * BOARD_SIZE / 2 ? 0 : 2) + (isQueen ? 1 : 0);
+    return mixHash(field * 4 + pawnType);
+}
+
+// computes zobrist hash of position with side to move and pawn that continues kill
+__host__ __device__ unsigned long long hashPosition(int* fields, bool* isQueen, bool blackTurn, int lastKill)
+{
+    unsigned long long hash = 0;
+    for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+        if (fields[i] >= 0)
+            hash ^= getPawnKey(i, fields[i], isQueen[fields[i]]);
+    if (blackTurn)
+        hash ^= mixHash(BOARD_SIZE * BOARD_SIZE * 4);
+    if (lastKill >= 0)
+        hash ^= mixHash(BOARD_SIZE * BOARD_SIZE * 4 + 1 + lastKill);
+    return hash;
+}
+
 // random number from [start, end)
-__host__ int h_getRandom(int start, int end)
+__host__ int h_getRandom(int start, int end, unsigned long long& state)
 {
-    return rand() % (end - start) + start;
+    return (int)(mixHash(state++) % (end - start)) + start;
 }
 
+#ifdef __CUDACC__
 // random number from [start, end)
 __device__ int d_getRandom(int start, int end, curandState* state)
 {
     return end - ceilf(curand_uniform(state) * (end - start));
 }
+#endif
+
+// random source of simulations run on host
+struct hostRandom {
+    unsigned long long state;
+
+    __host__ int operator()(int start, int end)
+    {
+        return h_getRandom(start, end, state);
+    }
+};
+
+#ifdef __CUDACC__
+// random source of simulations run on device
+struct deviceRandom {
+    curandState* state;
+
+    __device__ int operator()(int start, int end)
+    {
+        return d_getRandom(start, end, state);
+    }
+};
+#endif
+
+// key of move of pawn to field in all-moves-as-first statistics
+__host__ __device__ int getAmafKey(int pawn, int field)
+{
+    return pawn * BOARD_SIZE * BOARD_SIZE + field;
+}
 
-// performs random available move in data structures
-__host__ bool h_makeRandomAvailableMove(int* fields, int* rows, int* cols, bool* pawnHasKill, bool* isQueen, bool& blackTurn, bool* available, int& numOfWhite, int& numOfBlack, int pawnInChainKill = -1)
+// performs random available move in data structures, random source is resolved at compile time,
+// key of move is set in playedMoves bitset if given
+template <typename Random>
+__host__ __device__ bool makeRandomAvailableMove(int* fields, int* rows, int* cols, bool* pawnHasKill, bool* isQueen, bool& blackTurn, bool* available, int& numOfWhite, int& numOfBlack, Random& random, int pawnInChainKill = -1, unsigned int* playedMoves = nullptr)
 {
     bool isThereKill = false;
     int numOfPawnsWithKill = 0;
@@ -594,7 +1073,7 @@ __host__ bool h_makeRandomAvailableMove(int* fields, int* rows, int* cols, bool*
         }
         if (isThereKill)
         {
-            int rndPawn = h_getRandom(0, numOfPawnsWithKill);
+            int rndPawn = random(0, numOfPawnsWithKill);
             int counter = -1;
             while (counter < rndPawn)
             {
@@ -641,7 +1120,7 @@ __host__ bool h_makeRandomAvailableMove(int* fields, int* rows, int* cols, bool*
                 numOfBlack = 0;
                 return false;
             }
-            int possibleIdx = h_getRandom(0, numOfPossible);
+            int possibleIdx = random(0, numOfPossible);
             int counter = 0;
             for (int i = start; i < end; i++)
             {
@@ -665,7 +1144,7 @@ __host__ bool h_makeRandomAvailableMove(int* fields, int* rows, int* cols, bool*
             }
         }
     }
-    int rndMove = h_getRandom(0, numOfAvailable);
+    int rndMove = random(0, numOfAvailable);
     int avCounter = -1;
 
     for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
@@ -693,6 +1172,11 @@ __host__ bool h_makeRandomAvailableMove(int* fields, int* rows, int* cols, bool*
     fields[targetPos] = idx;
     rows[idx] = targetPos / BOARD_SIZE;
     cols[idx] = targetPos % BOARD_SIZE;
+    if (playedMoves != nullptr)
+    {
+        int key = getAmafKey(idx, targetPos);
+        playedMoves[key / 32] |= 1u << (key % 32);
+    }
 
     bool blockChainKill = false;
     if ((idx >= PAWN_ROWS * BOARD_SIZE / 2
@@ -708,287 +1192,518 @@ __host__ bool h_makeRandomAvailableMove(int* fields, int* rows, int* cols, bool*
         cols[idx], idx) : hasKill(fields, idx, rows, cols, true)))
     {
         nextPawnInChainKill = idx;
-        return h_makeRandomAvailableMove(fields, rows, cols, pawnHasKill, isQueen, blackTurn, available, numOfWhite, numOfBlack, nextPawnInChainKill);
+        return makeRandomAvailableMove(fields, rows, cols, pawnHasKill, isQueen, blackTurn, available, numOfWhite, numOfBlack, random, nextPawnInChainKill, playedMoves);
     }
     return numOfWhite > 0 && numOfBlack > 0;
 }
 
-// performs random available move in data structures
-__device__ bool d_makeRandomAvailableMove(int* fields, int* rows, int* cols, bool* pawnHasKill, bool* isQueen, bool& blackTurn, bool* available, int& numOfWhite, int& numOfBlack, curandState* state, int pawnInChainKill = -1)
+// forgets released nodes and game states of arena
+__host__ void clearFreeLists(nodeArena* arena)
 {
-    bool isThereKill = false;
-    int numOfPawnsWithKill = 0;
-    int numOfAvailable = 0;
-    clearAvailableFields(available, numOfAvailable);
-    int targetPos = -1;
-    int idx = blackTurn ? PAWN_ROWS * BOARD_SIZE / 2 - 1 : -1;
+    for (int i = 0; i <= MAX_CHILDREN; i++)
+        arena->freeBlocks[i] = -1;
+    arena->freeNodes = 0;
+    arena->freePosition = -1;
+    arena->freePositions = 0;
+}
 
-    if (pawnInChainKill >= 0)
+// inits arena of MCTS tree nodes, its chunks are charged to memory
+__host__ nodeArena* initArena(memoryBudget* memory)
+{
+    nodeArena* arena = new nodeArena;
+    arena->memory = memory;
+    for (int i = 0; i < ARENA_MAX_CHUNKS; i++)
     {
-        isThereKill = true;
-
-        idx = pawnInChainKill;
-        if (isQueen[idx])
-            setAvailableQueenKills(fields, rows[idx], cols[idx], idx, available, numOfAvailable);
-        else
-        {
-            setAvailableKills(fields, rows[idx], cols[idx], idx, true, available, numOfAvailable);
-            setAvailableKills(fields, rows[idx], cols[idx], idx, false, available, numOfAvailable);
-        }
-    }
-    else {
-        if (!blackTurn)
-        {
-            for (int i = 0; i < PAWN_ROWS * BOARD_SIZE / 2; i++)
-            {
-                pawnHasKill[i] = rows[i] >= 0 && (isQueen[i] ? hasQueenKill(fields, rows[i],
-                    cols[i], i) : hasKill(fields, i, rows, cols));
-                if (pawnHasKill[i])
-                {
-                    isThereKill = true;
-                    numOfPawnsWithKill++;
-                }
-            }
-        }
-        else
-        {
-            for (int i = PAWN_ROWS * BOARD_SIZE / 2; i < PAWN_ROWS * BOARD_SIZE; i++)
-            {
-                pawnHasKill[i] = rows[i] >= 0 && (isQueen[i] ? hasQueenKill(fields, rows[i],
-                    cols[i], i) : hasKill(fields, i, rows, cols));
-                if (pawnHasKill[i])
-                {
-                    isThereKill = true;
-                    numOfPawnsWithKill++;
-                }
-            }
-        }
-        if (isThereKill)
-        {
-            int rndPawn = d_getRandom(0, numOfPawnsWithKill, state);
-            int counter = -1;
-            while (counter < rndPawn)
-            {
-                idx++;
-                if (pawnHasKill[idx])
-                {
-                    counter++;
-                }
-            }
-            if (isQueen[idx])
-                setAvailableQueenKills(fields, rows[idx], cols[idx], idx, available, numOfAvailable);
-            else
-                setAvailableKills(fields, rows[idx], cols[idx], idx, idx < PAWN_ROWS* BOARD_SIZE / 2, available, numOfAvailable);
-        }
-        else
-        {
-            int numOfPossible = 0;
-            int start = blackTurn ? PAWN_ROWS * BOARD_SIZE / 2 : 0;
-            int end = blackTurn ? PAWN_ROWS * BOARD_SIZE : PAWN_ROWS * BOARD_SIZE / 2;
-            for (int i = start; i < end; i++)
-            {
-                if (rows[i] >= 0)
-                {
-                    numOfAvailable = 0;
-                    if (isQueen[i])
-                    {
-                        setAvailableQueenFields(rows[i], cols[i], nullptr, fields, numOfAvailable);
-                    }
-                    else
-                    {
-                        setAvailableFields(rows[i], cols[i], i < PAWN_ROWS* BOARD_SIZE / 2, nullptr, fields, numOfAvailable);
-                    }
-                    if (numOfAvailable > 0)
-                    {
-                        numOfPossible = numOfPossible + 1;
-                        available[i] = true;
-                    }
-                }
-            }
-            // draw
-            if (numOfPossible == 0)
-            {
-                numOfWhite = 0;
-                numOfBlack = 0;
-                return false;
-            }
-            int possibleIdx = d_getRandom(0, numOfPossible, state);
-            int counter = 0;
-            for (int i = start; i < end; i++)
-            {
-                if (available[i]) {
-                    if (counter == possibleIdx)
-                    {
-                        idx = i;
-                        break;
-                    }
-                    counter++;
-                }
-            }
-            clearAvailableFields(available, numOfAvailable);
-            if (isQueen[idx])
-            {
-                setAvailableQueenFields(rows[idx], cols[idx], available, fields, numOfAvailable);
-            }
-            else
-            {
-                setAvailableFields(rows[idx], cols[idx], idx < PAWN_ROWS* BOARD_SIZE / 2, available, fields, numOfAvailable);
-            }
-        }
+        arena->chunks[i] = nullptr;
+        arena->positionChunks[i] = nullptr;
     }
-    int rndMove = d_getRandom(0, numOfAvailable, state);
-    int avCounter = -1;
-
-    for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+    arena->numOfChunks = 0;
+    arena->size = 0;
+    arena->numOfPositionChunks = 0;
+    arena->numOfPositions = 0;
+    arena->transpositions = nullptr;
+    arena->generation = 0;
+    arena->snapshot = nullptr;
+    arena->snapshotBytes = 0;
+    clearFreeLists(arena);
+    if (TRANSPOSITIONS)
     {
-        if (available[i])
-        {
-            avCounter++;
-            if (avCounter == rndMove)
-            {
-                targetPos = i;
-                break;
-            }
-        }
+        arena->transpositions = new transpositionEntry[TRANSPOSITION_TABLE_SIZE];
+        for (int i = 0; i < TRANSPOSITION_TABLE_SIZE; i++)
+            arena->transpositions[i].generation = -1;
     }
-    fields[rows[idx] * BOARD_SIZE + cols[idx]] = -1;
-    int pawnToRemove;
-    if ((pawnToRemove = trackPawnToRemove(rows[idx], cols[idx], targetPos / BOARD_SIZE, targetPos % BOARD_SIZE, fields)) >= 0)
+    arena->recycleStack = nullptr;
+    arena->recycleBlocks = nullptr;
+    if (TREE_RECYCLE && !TRANSPOSITIONS)
     {
-        if (fields[pawnToRemove] < PAWN_ROWS * BOARD_SIZE / 2)
-            numOfWhite--;
-        else
-            numOfBlack--;
-        removePawn(pawnToRemove, rows, cols, fields);
+        arena->recycleStack = new int[RECYCLE_STACK_SIZE];
+        arena->recycleBlocks = new int[2 * RECYCLE_STACK_SIZE];
     }
-    fields[targetPos] = idx;
-    rows[idx] = targetPos / BOARD_SIZE;
-    cols[idx] = targetPos % BOARD_SIZE;
+    return arena;
+}
 
-    bool blockChainKill = false;
-    if ((idx >= PAWN_ROWS * BOARD_SIZE / 2
-        && rows[idx] == 0) ||
-        (idx < PAWN_ROWS * BOARD_SIZE / 2 &&
-            rows[idx] == BOARD_SIZE - 1))
-    {
-        isQueen[idx] = true;
-        blockChainKill = true;
-    }
-    int nextPawnInChainKill = -1;
-    if (isThereKill && !blockChainKill && (isQueen[idx] ? hasQueenKill(fields, rows[idx],
-        cols[idx], idx) : hasKill(fields, idx, rows, cols, true)))
+// reserves bytes of chunk in memory budget of arena, fails if TREE_MEMORY_LIMIT would be exceeded unless forced
+__host__ bool reserveBytes(nodeArena* arena, long long bytes, bool force)
+{
+    long long total = arena->memory->bytes.fetch_add(bytes) + bytes;
+    if (!force && TREE_MEMORY_LIMIT > 0 && total > TREE_MEMORY_LIMIT)
     {
-        nextPawnInChainKill = idx;
-        return d_makeRandomAvailableMove(fields, rows, cols, pawnHasKill, isQueen, blackTurn, available, numOfWhite, numOfBlack, state, nextPawnInChainKill);
+        arena->memory->bytes -= bytes;
+        return false;
     }
-    return numOfWhite > 0 && numOfBlack > 0;
+    long long peak = arena->memory->peakBytes.load();
+    while (total > peak && !arena->memory->peakBytes.compare_exchange_weak(peak, total));
+    return true;
 }
 
-// inits node in MCTS tree holding game state
-__host__ node* initNode(int* fields, int* rows, int* cols, bool* isQueen, bool blackTurn)
-{
-    node* state = new node;
-    state->fields = new int[BOARD_SIZE * BOARD_SIZE];
-    memcpy(state->fields, fields, BOARD_SIZE * BOARD_SIZE * sizeof(int));
-    state->rows = new int[PAWN_ROWS * BOARD_SIZE];
-    memcpy(state->rows, rows, PAWN_ROWS * BOARD_SIZE * sizeof(int));
-    state->cols = new int[PAWN_ROWS * BOARD_SIZE];
-    memcpy(state->cols, cols, PAWN_ROWS * BOARD_SIZE * sizeof(int));
-    state->isQueen = new bool[PAWN_ROWS * BOARD_SIZE];
-    memcpy(state->isQueen, isQueen, PAWN_ROWS * BOARD_SIZE * sizeof(bool));
-    state->childs = nullptr;
-    state->blackTurn = blackTurn;
-    state->lastKill = -1;
-    state->childSize = 0;
-    state->avgReward = 0;
-    state->howManyVisits = 0;
-
-    return state;
+// returns bytes of freed chunk to memory budget of arena
+__host__ void releaseBytes(nodeArena* arena, long long bytes)
+{
+    arena->memory->bytes -= bytes;
 }
 
-// expands MCTS tree for possible pawn kills
-__host__ void expandForPawnKills(int* fields, int row, int col, int idx, bool isWhite, node* root, bool changeTurn = true)
+// checks if chunk points into snapshot file mapped to memory by arena
+__host__ bool isSnapshotChunk(nodeArena* arena, void* chunk)
 {
-    int halfPawn = PAWN_ROWS * BOARD_SIZE / 2;
-    if (isWhite)
-    {
-        if (col > 1 && row < BOARD_SIZE - 2 &&
-            fields[(row + 2) * BOARD_SIZE + col - 2] < 0 &&
-            fields[(row + 1) * BOARD_SIZE + col - 1] >= 0 &&
-            fields[(row + 1) * BOARD_SIZE + col - 1] / halfPawn != idx / halfPawn)
-        {
-            root->childSize = root->childSize + 1;
-            node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-            if (newChilds == nullptr)
-            {
-                root->childSize = root->childSize - 1;
-                return;
-            }
-            else root->childs = newChilds;
+    return arena->snapshot != nullptr && (char*)chunk >= arena->snapshot && (char*)chunk < arena->snapshot + arena->snapshotBytes;
+}
 
-            node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, (changeTurn ? !(root->blackTurn) : root->blackTurn));
+// maps whole file to memory, changes stay private to process so that search can continue in it,
+// returns nullptr on failure
+__host__ char* mapFile(const char* path, long long* bytes)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER size;
+    HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL) : NULL;
+    char* view = mapping != NULL ? (char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0) : nullptr;
+    if (mapping != NULL)
+        CloseHandle(mapping);
+    CloseHandle(file);
+    *bytes = view != nullptr ? size.QuadPart : 0;
+    return view;
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        return nullptr;
+    struct stat info;
+    void* view = fstat(file, &info) == 0 && info.st_size > 0
+        ? mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0) : MAP_FAILED;
+    close(file);
+    *bytes = view != MAP_FAILED ? info.st_size : 0;
+    return view != MAP_FAILED ? (char*)view : nullptr;
+#endif
+}
 
-            child->rows[idx] = row + 2;
-            child->cols[idx] = col - 2;
+// releases file mapped by mapFile
+__host__ void unmapFile(char* view, long long bytes)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+#else
+    munmap(view, bytes);
+#endif
+}
 
-            removePawn(trackPawnToRemove(row, col, child->rows[idx], child->cols[idx], child->fields), child->rows, child->cols, child->fields);
+// frees memory allocated to arena
+__host__ void freeArena(nodeArena* arena)
+{
+    for (int i = 0; i < ARENA_MAX_CHUNKS; i++)
+    {
+        if (!isSnapshotChunk(arena, arena->chunks[i].load()))
+            delete[] arena->chunks[i].load();
+        if (!isSnapshotChunk(arena, arena->positionChunks[i].load()))
+            delete[] arena->positionChunks[i].load();
+    }
+    releaseBytes(arena, (long long)arena->numOfChunks * sizeof(nodeChunk)
+        + (long long)arena->numOfPositionChunks * ARENA_CHUNK_SIZE * sizeof(packedPosition));
+    if (arena->snapshot != nullptr)
+        unmapFile(arena->snapshot, arena->snapshotBytes);
+    delete[] arena->transpositions;
+    delete[] arena->recycleStack;
+    delete[] arena->recycleBlocks;
+    delete arena;
+}
 
-            child->fields[row * BOARD_SIZE + col] = -1;
-            child->fields[(row + 2) * BOARD_SIZE + col - 2] = idx;
+// drops all nodes at once, chunks are kept for next search
+__host__ void resetArena(nodeArena* arena)
+{
+    arena->size = 0;
+    arena->numOfPositions = 0;
+    arena->generation++;
+    clearFreeLists(arena);
+}
 
+// frees chunks past nodes and game states in use and returns their bytes to memory budget
+__host__ void trimArena(nodeArena* arena)
+{
+    for (int i = (arena->size + ARENA_CHUNK_SIZE - 1) >> ARENA_CHUNK_SHIFT; i < ARENA_MAX_CHUNKS; i++)
+    {
+        nodeChunk* chunk = arena->chunks[i].exchange(nullptr);
+        if (chunk == nullptr)
+            continue;
+        if (!isSnapshotChunk(arena, chunk))
+            delete[] chunk;
+        arena->numOfChunks--;
+        releaseBytes(arena, sizeof(nodeChunk));
+    }
+    for (int i = (arena->numOfPositions + ARENA_CHUNK_SIZE - 1) >> ARENA_CHUNK_SHIFT; i < ARENA_MAX_CHUNKS; i++)
+    {
+        packedPosition* chunk = arena->positionChunks[i].exchange(nullptr);
+        if (chunk == nullptr)
+            continue;
+        if (!isSnapshotChunk(arena, chunk))
+            delete[] chunk;
+        arena->numOfPositionChunks--;
+        releaseBytes(arena, ARENA_CHUNK_SIZE * sizeof(packedPosition));
+    }
+}
 
-            if ((child->isQueen[idx] ? hasQueenKill(child->fields, child->rows[idx], child->cols[idx], idx) : hasKill(child->fields, idx, child->rows, child->cols, true)))
-                child->lastKill = idx;
+// gets chunk holding node with given index
+__host__ nodeChunk* getChunk(nodeArena* arena, int idx)
+{
+    return arena->chunks[idx >> ARENA_CHUNK_SHIFT].load(std::memory_order_acquire);
+}
 
-            if ((idx < PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == BOARD_SIZE - 1)
-                || (idx >= PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == 0))
-            {
-                if (!child->isQueen[idx])
-                    child->lastKill = -1;
-                child->isQueen[idx] = true;
-            }
+// gets game state kept in arena by its index
+__host__ packedPosition* getPosition(nodeArena* arena, int position)
+{
+    return &arena->positionChunks[position >> ARENA_CHUNK_SHIFT].load(std::memory_order_acquire)[NODE_OFFSET(position)];
+}
 
-            root->childs[root->childSize - 1] = child;
-            child->parent = root;
-        }
+// unpacks game state kept in arena into state, returns state
+__host__ node* loadPosition(nodeArena* arena, int position, node* state)
+{
+    packedPosition* packed = getPosition(arena, position);
+    for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+        state->fields[i] = packed->fields[i];
+    for (int i = 0; i < PAWN_ROWS * BOARD_SIZE; i++)
+    {
+        state->rows[i] = packed->rows[i];
+        state->cols[i] = packed->cols[i];
+        state->isQueen[i] = (packed->queens >> i) & 1;
+    }
+    state->blackTurn = packed->blackTurn;
+    state->lastKill = packed->lastKill;
+    return state;
+}
 
-        if (col < BOARD_SIZE - 2 && row < BOARD_SIZE - 2 &&
-            fields[(row + 2) * BOARD_SIZE + col + 2] < 0 &&
-            fields[(row + 1) * BOARD_SIZE + col + 1] >= 0 &&
-            fields[(row + 1) * BOARD_SIZE + col + 1] / halfPawn != idx / halfPawn)
-        {
-            root->childSize = root->childSize + 1;
-            node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-            if (newChilds == nullptr)
-            {
-                root->childSize = root->childSize - 1;
-                return;
-            }
-            else root->childs = newChilds;
+// allocates chunk for given index unless other thread already did it, its bytes are reserved first,
+// returns false if index is past last chunk or limit of memory is reached and reservation isn't forced
+template <typename Chunk>
+__host__ bool installChunk(nodeArena* arena, std::atomic<Chunk*>* chunks, std::atomic<int>& numOfChunks, int idx,
+    Chunk* (*allocate)(), long long chunkBytes, bool force)
+{
+    if ((idx >> ARENA_CHUNK_SHIFT) >= ARENA_MAX_CHUNKS)
+        return false;
+    std::atomic<Chunk*>& slot = chunks[idx >> ARENA_CHUNK_SHIFT];
+    if (slot.load(std::memory_order_acquire) != nullptr)
+        return true;
+    if (!reserveBytes(arena, chunkBytes, force))
+        return false;
+    Chunk* chunk = allocate();
+    Chunk* expected = nullptr;
+    if (slot.compare_exchange_strong(expected, chunk, std::memory_order_acq_rel))
+        numOfChunks++;
+    else
+    {
+        delete[] chunk;
+        releaseBytes(arena, chunkBytes);
+    }
+    return true;
+}
 
-            node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, (changeTurn ? !(root->blackTurn) : root->blackTurn));
+// allocates chunk of ARENA_CHUNK_SIZE nodes
+__host__ nodeChunk* allocateNodeChunk()
+{
+    return new nodeChunk[1];
+}
 
-            child->rows[idx] = row + 2;
-            child->cols[idx] = col + 2;
+// allocates chunk of ARENA_CHUNK_SIZE game states
+__host__ packedPosition* allocatePositionChunk()
+{
+    return new packedPosition[ARENA_CHUNK_SIZE];
+}
 
-            removePawn(trackPawnToRemove(row, col, child->rows[idx], child->cols[idx], child->fields), child->rows, child->cols, child->fields);
+// bytes of nodes and game states in use by tree in arena
+__host__ long long treeBytes(nodeArena* arena)
+{
+    return (long long)(arena->size - arena->freeNodes) * (sizeof(nodeChunk) / ARENA_CHUNK_SIZE)
+        + (long long)(arena->numOfPositions - arena->freePositions) * sizeof(packedPosition);
+}
 
-            child->fields[row * BOARD_SIZE + col] = -1;
-            child->fields[(row + 2) * BOARD_SIZE + col + 2] = idx;
+// keeps copy of packed game state in arena, returns its index or -1 if arena is full
+__host__ int storePackedPosition(nodeArena* arena, packedPosition* packed)
+{
+    if (arena->freePositions > 0)
+    {
+        int position = arena->freePosition;
+        arena->freePosition = (int)getPosition(arena, position)->queens;
+        arena->freePositions--;
+        *getPosition(arena, position) = *packed;
+        return position;
+    }
+    // chunk is allocated before index is taken, thread which raced past it into next chunk allocates that one anyway
+    long long chunkBytes = ARENA_CHUNK_SIZE * sizeof(packedPosition);
+    if (!installChunk(arena, arena->positionChunks, arena->numOfPositionChunks, arena->numOfPositions, allocatePositionChunk, chunkBytes, false))
+        return -1;
+    int position = arena->numOfPositions++;
+    if (!installChunk(arena, arena->positionChunks, arena->numOfPositionChunks, position, allocatePositionChunk, chunkBytes, true))
+        return -1;
+    *getPosition(arena, position) = *packed;
+    return position;
+}
 
-            if ((child->isQueen[idx] ? hasQueenKill(child->fields, child->rows[idx], child->cols[idx], idx) : hasKill(child->fields, idx, child->rows, child->cols, true)))
-                child->lastKill = idx;
+// keeps copy of game state in arena, returns its index or -1 if arena is full
+__host__ int storePosition(nodeArena* arena, node* state)
+{
+    packedPosition packed;
+    packed.queens = 0;
+    for (int i = 0; i < PAWN_ROWS * BOARD_SIZE; i++)
+    {
+        packed.rows[i] = (signed char)state->rows[i];
+        packed.cols[i] = (signed char)state->cols[i];
+        packed.queens |= (unsigned int)state->isQueen[i] << i;
+    }
+    for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+        packed.fields[i] = (signed char)state->fields[i];
+    packed.blackTurn = state->blackTurn;
+    packed.lastKill = (signed char)state->lastKill;
+    return storePackedPosition(arena, &packed);
+}
 
-            if ((idx < PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == BOARD_SIZE - 1)
-                || (idx >= PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == 0))
-            {
-                if (!child->isQueen[idx])
-                    child->lastKill = -1;
-                child->isQueen[idx] = true;
-            }
+// number of simulations backed up through node
+__host__ std::atomic<int>& nodeVisits(nodeArena* arena, int idx)
+{
+    return getChunk(arena, idx)->visits[NODE_OFFSET(idx)];
+}
+
+// sum of rewards of node from perspective of player who moved into it
+__host__ std::atomic<float>& nodeRewardSum(nodeArena* arena, int idx)
+{
+    return getChunk(arena, idx)->rewardSum[NODE_OFFSET(idx)];
+}
+
+// index of first of contiguous children of node
+__host__ int& nodeFirstChild(nodeArena* arena, int idx)
+{
+    return getChunk(arena, idx)->firstChild[NODE_OFFSET(idx)];
+}
+
+// number of children of node, 0 until it's expanded
+__host__ std::atomic<unsigned char>& nodeChildSize(nodeArena* arena, int idx)
+{
+    return getChunk(arena, idx)->childSize[NODE_OFFSET(idx)];
+}
+
+// index of parent of node, -1 for root
+__host__ int& nodeParent(nodeArena* arena, int idx)
+{
+    return getChunk(arena, idx)->parent[NODE_OFFSET(idx)];
+}
+
+// NODE_ flags of node
+__host__ std::atomic<unsigned short>& nodeFlags(nodeArena* arena, int idx)
+{
+    return getChunk(arena, idx)->flags[NODE_OFFSET(idx)];
+}
+
+// index of game state of node kept in arena, -1 if it's built on descent
+__host__ std::atomic<int>& nodePosition(nodeArena* arena, int idx)
+{
+    return getChunk(arena, idx)->position[NODE_OFFSET(idx)];
+}
+
+#if RAVE
+// weight of all-moves-as-first simulations of move leading to node
+__host__ std::atomic<float>& nodeAmafVisits(nodeArena* arena, int idx)
+{
+    return getChunk(arena, idx)->amafVisits[NODE_OFFSET(idx)];
+}
+
+// sum of all-moves-as-first rewards of move leading to node
+__host__ std::atomic<float>& nodeAmafRewardSum(nodeArena* arena, int idx)
+{
+    return getChunk(arena, idx)->amafRewardSum[NODE_OFFSET(idx)];
+}
+#endif
+
+// adds value to reward sum shared by threads
+__host__ void addReward(std::atomic<float>& rewardSum, float value)
+{
+    float current = rewardSum.load(std::memory_order_relaxed);
+    while (!rewardSum.compare_exchange_weak(current, current + value, std::memory_order_relaxed));
+}
+
+// releases game state kept in arena
+__host__ void releasePosition(nodeArena* arena, int position)
+{
+    getPosition(arena, position)->queens = (unsigned int)arena->freePosition;
+    arena->freePosition = position;
+    arena->freePositions++;
+}
+
+// releases count nodes next to each other for reuse
+__host__ void releaseNodes(nodeArena* arena, int first, int count)
+{
+    nodeFirstChild(arena, first) = arena->freeBlocks[count];
+    arena->freeBlocks[count] = first;
+    arena->freeNodes += count;
+}
+
+// takes smallest released block of at least count nodes, rest of it is released again, returns -1 if there is none
+__host__ int takeFreeNodes(nodeArena* arena, int count)
+{
+    if (arena->freeNodes < count)
+        return -1;
+    for (int size = count; size <= MAX_CHILDREN; size++)
+    {
+        int first = arena->freeBlocks[size];
+        if (first < 0)
+            continue;
+        arena->freeBlocks[size] = nodeFirstChild(arena, first);
+        arena->freeNodes -= size;
+        if (size > count)
+            releaseNodes(arena, first + count, size - count);
+        return first;
+    }
+    return -1;
+}
+
+// merges released blocks lying next to each other in same chunk so that bigger families of children fit in them
+__host__ void coalesceFreeNodes(nodeArena* arena)
+{
+    // blocks are sorted by packed first node and size
+    long long* blocks = new long long[arena->freeNodes];
+    int numOfBlocks = 0;
+    for (int size = 1; size <= MAX_CHILDREN; size++)
+        for (int first = arena->freeBlocks[size]; first >= 0; first = nodeFirstChild(arena, first))
+            blocks[numOfBlocks++] = ((long long)first << 8) | size;
+    std::sort(blocks, blocks + numOfBlocks);
+
+    for (int i = 0; i <= MAX_CHILDREN; i++)
+        arena->freeBlocks[i] = -1;
+    arena->freeNodes = 0;
+    int first = -1, size = 0;
+    for (int i = 0; i <= numOfBlocks; i++)
+    {
+        int blockFirst = i < numOfBlocks ? (int)(blocks[i] >> 8) : -1;
+        int blockSize = (int)(blocks[i < numOfBlocks ? i : 0] & 0xFF);
+        if (i < numOfBlocks && first + size == blockFirst && NODE_OFFSET(blockFirst) != 0 && size + blockSize <= MAX_CHILDREN)
+        {
+            size += blockSize;
+            continue;
+        }
+        if (first >= 0)
+            releaseNodes(arena, first, size);
+        first = blockFirst;
+        size = blockSize;
+    }
+    delete[] blocks;
+}
+
+// allocates count nodes next to each other in single chunk, returns index of first of them or -1 if arena is full
+__host__ int allocNodes(nodeArena* arena, int count)
+{
+    int first = takeFreeNodes(arena, count);
+    if (first >= 0)
+        return first;
+    while (true)
+    {
+        // nodes crossing end of chunk are placed in next one, so last of them decides which chunk is needed,
+        // thread which raced past it into next chunk allocates that one anyway
+        if (!installChunk(arena, arena->chunks, arena->numOfChunks, arena->size.load(std::memory_order_relaxed) + count - 1,
+            allocateNodeChunk, sizeof(nodeChunk), false))
+            return -1;
+        int first = arena->size.fetch_add(count);
+        // nodes which would cross end of chunk are skipped
+        if (NODE_OFFSET(first) + count > ARENA_CHUNK_SIZE)
+            continue;
+        if (!installChunk(arena, arena->chunks, arena->numOfChunks, first, allocateNodeChunk, sizeof(nodeChunk), true))
+            return -1;
+        return first;
+    }
+}
+
+// inits node in MCTS tree without game state
+__host__ void initNode(nodeArena* arena, int idx, int parent, bool blackTurn, bool blackMoved)
+{
+    nodeChunk* chunk = getChunk(arena, idx);
+    int offset = NODE_OFFSET(idx);
+    chunk->visits[offset].store(0, std::memory_order_relaxed);
+    chunk->rewardSum[offset].store(0, std::memory_order_relaxed);
+    chunk->firstChild[offset] = -1;
+    chunk->childSize[offset].store(0, std::memory_order_relaxed);
+    chunk->parent[offset] = parent;
+    chunk->flags[offset].store((blackTurn ? NODE_BLACK_TURN : 0) | (blackMoved ? NODE_BLACK_MOVED : 0), std::memory_order_relaxed);
+    chunk->position[offset].store(-1, std::memory_order_relaxed);
+#if PUCT
+    chunk->prior[offset] = 0;
+#endif
+#if RAVE
+    chunk->amafVisits[offset].store(0, std::memory_order_relaxed);
+    chunk->amafRewardSum[offset].store(0, std::memory_order_relaxed);
+#endif
+}
+
+// inits root of MCTS tree holding copy of game state, returns its index or -1 if arena is full
+__host__ int initRoot(nodeArena* arena, int* fields, int* rows, int* cols, bool* isQueen, bool blackTurn)
+{
+    node state;
+    memcpy(state.fields, fields, BOARD_SIZE * BOARD_SIZE * sizeof(int));
+    memcpy(state.rows, rows, PAWN_ROWS * BOARD_SIZE * sizeof(int));
+    memcpy(state.cols, cols, PAWN_ROWS * BOARD_SIZE * sizeof(int));
+    memcpy(state.isQueen, isQueen, PAWN_ROWS * BOARD_SIZE * sizeof(bool));
+    state.blackTurn = blackTurn;
+    state.lastKill = -1;
+
+    int idx = allocNodes(arena, 1);
+    if (idx < 0)
+        return -1;
+    initNode(arena, idx, -1, blackTurn, !blackTurn);
+    if ((nodePosition(arena, idx) = storePosition(arena, &state)) < 0)
+        return -1;
+    return idx;
+}
+
+// adds move of pawn to given field to list
+__host__ bool addMove(moveList* moves, int pawn, int row, int col, unsigned char moveFlags)
+{
+    if (moves->size == MAX_CHILDREN)
+        return false;
+    edgeMove& move = moves->moves[moves->size++];
+    move.pawn = pawn;
+    move.row = row;
+    move.col = col;
+    move.flags = moveFlags;
+    return true;
+}
+
+// expands MCTS tree for possible pawn kills
+__host__ void expandForPawnKills(moveList* moves, int* fields, int row, int col, int idx, bool isWhite, bool changeTurn = true)
+{
+    int halfPawn = PAWN_ROWS * BOARD_SIZE / 2;
+    unsigned char killFlags = MOVE_KILL | (changeTurn ? MOVE_CHANGE_TURN : 0);
+    if (isWhite)
+    {
+        if (col > 1 && row < BOARD_SIZE - 2 &&
+            fields[(row + 2) * BOARD_SIZE + col - 2] < 0 &&
+            fields[(row + 1) * BOARD_SIZE + col - 1] >= 0 &&
+            fields[(row + 1) * BOARD_SIZE + col - 1] / halfPawn != idx / halfPawn)
+        {
+            if (!addMove(moves, idx, row + 2, col - 2, killFlags))
+                return;
+        }
 
-            root->childs[root->childSize - 1] = child;
-            child->parent = root;
+        if (col < BOARD_SIZE - 2 && row < BOARD_SIZE - 2 &&
+            fields[(row + 2) * BOARD_SIZE + col + 2] < 0 &&
+            fields[(row + 1) * BOARD_SIZE + col + 1] >= 0 &&
+            fields[(row + 1) * BOARD_SIZE + col + 1] / halfPawn != idx / halfPawn)
+        {
+            if (!addMove(moves, idx, row + 2, col + 2, killFlags))
+                return;
         }
     }
     else if (!isWhite)
@@ -998,84 +1713,25 @@ __host__ void expandForPawnKills(int* fields, int row, int col, int idx, bool is
             fields[(row - 1) * BOARD_SIZE + col - 1] >= 0 &&
             fields[(row - 1) * BOARD_SIZE + col - 1] / halfPawn != idx / halfPawn)
         {
-            root->childSize = root->childSize + 1;
-            node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-            if (newChilds == nullptr)
-            {
-                root->childSize = root->childSize - 1;
+            if (!addMove(moves, idx, row - 2, col - 2, killFlags))
                 return;
-            }
-            else root->childs = newChilds;
-
-            node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, (changeTurn ? !(root->blackTurn) : root->blackTurn));
-
-            child->rows[idx] = row - 2;
-            child->cols[idx] = col - 2;
-
-            removePawn(trackPawnToRemove(row, col, child->rows[idx], child->cols[idx], child->fields), child->rows, child->cols, child->fields);
-
-            child->fields[row * BOARD_SIZE + col] = -1;
-            child->fields[(row - 2) * BOARD_SIZE + col - 2] = idx;
-
-            if ((child->isQueen[idx] ? hasQueenKill(child->fields, child->rows[idx], child->cols[idx], idx) : hasKill(child->fields, idx, child->rows, child->cols, true)))
-                child->lastKill = idx;
-
-            if ((idx < PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == BOARD_SIZE - 1)
-                || (idx >= PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == 0))
-            {
-                if (!child->isQueen[idx])
-                    child->lastKill = -1;
-                child->isQueen[idx] = true;
-            }
-
-            root->childs[root->childSize - 1] = child;
-            child->parent = root;
         }
         if (col < BOARD_SIZE - 2 && row > 1 &&
             fields[(row - 2) * BOARD_SIZE + col + 2] < 0 &&
             fields[(row - 1) * BOARD_SIZE + col + 1] >= 0 &&
             fields[(row - 1) * BOARD_SIZE + col + 1] / halfPawn != idx / halfPawn)
         {
-            root->childSize = root->childSize + 1;
-            node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-            if (newChilds == nullptr)
-            {
-                root->childSize = root->childSize - 1;
+            if (!addMove(moves, idx, row - 2, col + 2, killFlags))
                 return;
-            }
-            else root->childs = newChilds;
-
-            node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, (changeTurn ? !(root->blackTurn) : root->blackTurn));
-
-            child->rows[idx] = row - 2;
-            child->cols[idx] = col + 2;
-
-            removePawn(trackPawnToRemove(row, col, child->rows[idx], child->cols[idx], child->fields), child->rows, child->cols, child->fields);
-
-            child->fields[row * BOARD_SIZE + col] = -1;
-            child->fields[(row - 2) * BOARD_SIZE + col + 2] = idx;
-
-            if ((child->isQueen[idx] ? hasQueenKill(child->fields, child->rows[idx], child->cols[idx], idx) : hasKill(child->fields, idx, child->rows, child->cols, true)))
-                child->lastKill = idx;
-
-            if ((idx < PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == BOARD_SIZE - 1)
-                || (idx >= PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == 0))
-            {
-                if (!child->isQueen[idx])
-                    child->lastKill = -1;
-                child->isQueen[idx] = true;
-            }
-
-            root->childs[root->childSize - 1] = child;
-            child->parent = root;
         }
     }
 }
 
 // expands MCTS tree for possible queen kills
-__host__ void expandForQueenKill(int* fields, int row, int col, int idx, node* root, bool changeTurn = true)
+__host__ void expandForQueenKill(moveList* moves, int* fields, int row, int col, int idx, bool changeTurn = true)
 {
     int halfPawn = PAWN_ROWS * BOARD_SIZE / 2;
+    unsigned char killFlags = MOVE_KILL | (changeTurn ? MOVE_CHANGE_TURN : 0);
 
     for (int r = row + 1, c = col - 1; r < BOARD_SIZE - 1 && c > 0; r++, c--)
     {
@@ -1084,29 +1740,8 @@ __host__ void expandForQueenKill(int* fields, int row, int col, int idx, node* r
             if (fields[r * BOARD_SIZE + c] / halfPawn != idx / halfPawn
                 && fields[(r + 1) * BOARD_SIZE + c - 1] < 0)
             {
-                root->childSize = root->childSize + 1;
-                node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-                if (newChilds == nullptr)
-                {
+                if (!addMove(moves, idx, r + 1, c - 1, killFlags))
                     return;
-                }
-                else root->childs = newChilds;
-
-                node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, (changeTurn ? !(root->blackTurn) : root->blackTurn));
-
-                child->rows[idx] = r + 1;
-                child->cols[idx] = c - 1;
-
-                removePawn(trackPawnToRemove(row, col, child->rows[idx], child->cols[idx], child->fields), child->rows, child->cols, child->fields);
-
-                child->fields[row * BOARD_SIZE + col] = -1;
-                child->fields[(r + 1) * BOARD_SIZE + c - 1] = idx;
-
-                if ((child->isQueen[idx] ? hasQueenKill(child->fields, child->rows[idx], child->cols[idx], idx) : hasKill(child->fields, idx, child->rows, child->cols, true)))
-                    child->lastKill = idx;
-
-                root->childs[root->childSize - 1] = child;
-                child->parent = root;
             }
             break;
         }
@@ -1118,29 +1753,8 @@ __host__ void expandForQueenKill(int* fields, int row, int col, int idx, node* r
             if (fields[r * BOARD_SIZE + c] / halfPawn != idx / halfPawn
                 && fields[(r + 1) * BOARD_SIZE + c + 1] < 0)
             {
-                root->childSize = root->childSize + 1;
-                node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-                if (newChilds == nullptr)
-                {
+                if (!addMove(moves, idx, r + 1, c + 1, killFlags))
                     return;
-                }
-                else root->childs = newChilds;
-
-                node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, (changeTurn ? !(root->blackTurn) : root->blackTurn));
-
-                child->rows[idx] = r + 1;
-                child->cols[idx] = c + 1;
-
-                removePawn(trackPawnToRemove(row, col, child->rows[idx], child->cols[idx], child->fields), child->rows, child->cols, child->fields);
-
-                child->fields[row * BOARD_SIZE + col] = -1;
-                child->fields[(r + 1) * BOARD_SIZE + c + 1] = idx;
-
-                if ((child->isQueen[idx] ? hasQueenKill(child->fields, child->rows[idx], child->cols[idx], idx) : hasKill(child->fields, idx, child->rows, child->cols, true)))
-                    child->lastKill = idx;
-
-                root->childs[root->childSize - 1] = child;
-                child->parent = root;
             }
             break;
         }
@@ -1152,29 +1766,8 @@ __host__ void expandForQueenKill(int* fields, int row, int col, int idx, node* r
             if (fields[r * BOARD_SIZE + c] / halfPawn != idx / halfPawn
                 && fields[(r - 1) * BOARD_SIZE + c - 1] < 0)
             {
-                root->childSize = root->childSize + 1;
-                node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-                if (newChilds == nullptr)
-                {
+                if (!addMove(moves, idx, r - 1, c - 1, killFlags))
                     return;
-                }
-                else root->childs = newChilds;
-
-                node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, (changeTurn ? !(root->blackTurn) : root->blackTurn));
-
-                child->rows[idx] = r - 1;
-                child->cols[idx] = c - 1;
-
-                removePawn(trackPawnToRemove(row, col, child->rows[idx], child->cols[idx], child->fields), child->rows, child->cols, child->fields);
-
-                child->fields[row * BOARD_SIZE + col] = -1;
-                child->fields[(r - 1) * BOARD_SIZE + c - 1] = idx;
-
-                if ((child->isQueen[idx] ? hasQueenKill(child->fields, child->rows[idx], child->cols[idx], idx) : hasKill(child->fields, idx, child->rows, child->cols, true)))
-                    child->lastKill = idx;
-
-                root->childs[root->childSize - 1] = child;
-                child->parent = root;
             }
             break;
         }
@@ -1186,29 +1779,8 @@ __host__ void expandForQueenKill(int* fields, int row, int col, int idx, node* r
             if (fields[r * BOARD_SIZE + c] / halfPawn != idx / halfPawn
                 && fields[(r - 1) * BOARD_SIZE + c + 1] < 0)
             {
-                root->childSize = root->childSize + 1;
-                node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-                if (newChilds == nullptr)
-                {
+                if (!addMove(moves, idx, r - 1, c + 1, killFlags))
                     return;
-                }
-                else root->childs = newChilds;
-
-                node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, (changeTurn ? !(root->blackTurn) : root->blackTurn));
-
-                child->rows[idx] = r - 1;
-                child->cols[idx] = c + 1;
-
-                removePawn(trackPawnToRemove(row, col, child->rows[idx], child->cols[idx], child->fields), child->rows, child->cols, child->fields);
-
-                child->fields[row * BOARD_SIZE + col] = -1;
-                child->fields[(r - 1) * BOARD_SIZE + c + 1] = idx;
-
-                if ((child->isQueen[idx] ? hasQueenKill(child->fields, child->rows[idx], child->cols[idx], idx) : hasKill(child->fields, idx, child->rows, child->cols, true)))
-                    child->lastKill = idx;
-
-                root->childs[root->childSize - 1] = child;
-                child->parent = root;
             }
             break;
         }
@@ -1216,225 +1788,88 @@ __host__ void expandForQueenKill(int* fields, int row, int col, int idx, node* r
 }
 
 // expands MCTS tree for possible pawn moves
-__host__ void expandForPawnMoves(int row, int col, int idx, int* fields, node* root)
+__host__ void expandForPawnMoves(moveList* moves, node* root, int row, int col, int idx)
 {
+    int* fields = root->fields;
     if (!(root->blackTurn) && row < BOARD_SIZE - 1)
     {
         if (col > 0 && fields[(row + 1) * BOARD_SIZE + col - 1] < 0)
         {
-            root->childSize = root->childSize + 1;
-            node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-            if (newChilds == nullptr)
-            {
+            if (!addMove(moves, idx, row + 1, col - 1, MOVE_CHANGE_TURN))
                 return;
-            }
-            else root->childs = newChilds;
-
-            node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, !(root->blackTurn));
-
-            child->rows[idx] = row + 1;
-            child->cols[idx] = col - 1;
-            child->fields[row * BOARD_SIZE + col] = -1;
-            child->fields[(row + 1) * BOARD_SIZE + col - 1] = idx;
-            if ((idx < PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == BOARD_SIZE - 1)
-                || (idx >= PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == 0))
-                child->isQueen[idx] = true;
-
-            root->childs[root->childSize - 1] = child;
-            child->parent = root;
         }
         if (col < BOARD_SIZE - 1 && fields[(row + 1) * BOARD_SIZE + col + 1] < 0)
         {
-            root->childSize = root->childSize + 1;
-            node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-            if (newChilds == nullptr)
-            {
+            if (!addMove(moves, idx, row + 1, col + 1, MOVE_CHANGE_TURN))
                 return;
-            }
-            else root->childs = newChilds;
-
-            node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, !(root->blackTurn));
-
-            child->rows[idx] = row + 1;
-            child->cols[idx] = col + 1;
-            child->fields[row * BOARD_SIZE + col] = -1;
-            child->fields[(row + 1) * BOARD_SIZE + col + 1] = idx;
-            if ((idx < PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == BOARD_SIZE - 1)
-                || (idx >= PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == 0))
-                child->isQueen[idx] = true;
-
-            root->childs[root->childSize - 1] = child;
-            child->parent = root;
         }
     }
     else if (root->blackTurn && row > 0)
     {
         if (col > 0 && fields[(row - 1) * BOARD_SIZE + col - 1] < 0)
         {
-            root->childSize = root->childSize + 1;
-            node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-            if (newChilds == nullptr)
-            {
-                root->childSize = root->childSize - 1;
+            if (!addMove(moves, idx, row - 1, col - 1, MOVE_CHANGE_TURN))
                 return;
-            }
-            else root->childs = newChilds;
-
-            node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, !(root->blackTurn));
-
-            child->rows[idx] = row - 1;
-            child->cols[idx] = col - 1;
-            child->fields[row * BOARD_SIZE + col] = -1;
-            child->fields[(row - 1) * BOARD_SIZE + col - 1] = idx;
-            if ((idx < PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == BOARD_SIZE - 1)
-                || (idx >= PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == 0))
-                child->isQueen[idx] = true;
-
-            root->childs[root->childSize - 1] = child;
-            child->parent = root;
         }
         if (col < BOARD_SIZE - 1 && fields[(row - 1) * BOARD_SIZE + col + 1] < 0)
         {
-            root->childSize = root->childSize + 1;
-            node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-            if (newChilds == nullptr)
-            {
-                root->childSize = root->childSize - 1;
+            if (!addMove(moves, idx, row - 1, col + 1, MOVE_CHANGE_TURN))
                 return;
-            }
-            else root->childs = newChilds;
-
-            node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, !(root->blackTurn));
-
-            child->rows[idx] = row - 1;
-            child->cols[idx] = col + 1;
-            child->fields[row * BOARD_SIZE + col] = -1;
-            child->fields[(row - 1) * BOARD_SIZE + col + 1] = idx;
-            if ((idx < PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == BOARD_SIZE - 1)
-                || (idx >= PAWN_ROWS * BOARD_SIZE / 2 && child->rows[idx] == 0))
-                child->isQueen[idx] = true;
-
-            root->childs[root->childSize - 1] = child;
-            child->parent = root;
         }
     }
 }
 
 // expands MCTS tree for possible queen moves
-__host__ void expandForQueenMoves(int row, int col, int idx, int* fields, node* root)
+__host__ void expandForQueenMoves(moveList* moves, int* fields, int row, int col, int idx)
 {
     for (int r = row - 1, c = col - 1; r >= 0 && c >= 0; r--, c--)
     {
         if (fields[r * BOARD_SIZE + c] >= 0)
             break;
 
-        root->childSize = root->childSize + 1;
-        node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-        if (newChilds == nullptr)
-        {
-            root->childSize = root->childSize - 1;
+        if (!addMove(moves, idx, r, c, MOVE_CHANGE_TURN))
             return;
-        }
-        else root->childs = newChilds;
-
-        node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, !(root->blackTurn));
-
-        child->rows[idx] = r;
-        child->cols[idx] = c;
-        child->fields[row * BOARD_SIZE + col] = -1;
-        child->fields[r * BOARD_SIZE + c] = idx;
-
-        root->childs[root->childSize - 1] = child;
-        child->parent = root;
     }
     for (int r = row + 1, c = col + 1; r < BOARD_SIZE && c < BOARD_SIZE; r++, c++)
     {
         if (fields[r * BOARD_SIZE + c] >= 0)
             break;
 
-        root->childSize = root->childSize + 1;
-        node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-        if (newChilds == nullptr)
-        {
-            root->childSize = root->childSize - 1;
+        if (!addMove(moves, idx, r, c, MOVE_CHANGE_TURN))
             return;
-        }
-        else root->childs = newChilds;
-
-        node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, !(root->blackTurn));
-
-        child->rows[idx] = r;
-        child->cols[idx] = c;
-        child->fields[row * BOARD_SIZE + col] = -1;
-        child->fields[r * BOARD_SIZE + c] = idx;
-
-        root->childs[root->childSize - 1] = child;
-        child->parent = root;
     }
     for (int r = row - 1, c = col + 1; r >= 0 && c < BOARD_SIZE; r--, c++)
     {
         if (fields[r * BOARD_SIZE + c] >= 0)
             break;
 
-        root->childSize = root->childSize + 1;
-        node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-        if (newChilds == nullptr)
-        {
-            root->childSize = root->childSize - 1;
+        if (!addMove(moves, idx, r, c, MOVE_CHANGE_TURN))
             return;
-        }
-        else root->childs = newChilds;
-
-        node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, !(root->blackTurn));
-
-        child->rows[idx] = r;
-        child->cols[idx] = c;
-        child->fields[row * BOARD_SIZE + col] = -1;
-        child->fields[r * BOARD_SIZE + c] = idx;
-
-        root->childs[root->childSize - 1] = child;
-        child->parent = root;
     }
     for (int r = row + 1, c = col - 1; r < BOARD_SIZE && c >= 0; r++, c--)
     {
         if (fields[r * BOARD_SIZE + c] >= 0)
             break;
 
-        root->childSize = root->childSize + 1;
-        node** newChilds = (node**)realloc(root->childs, root->childSize * sizeof(node*));
-        if (newChilds == nullptr)
-        {
-            root->childSize = root->childSize - 1;
+        if (!addMove(moves, idx, r, c, MOVE_CHANGE_TURN))
             return;
-        }
-        else root->childs = newChilds;
-
-        node* child = initNode(root->fields, root->rows, root->cols, root->isQueen, !(root->blackTurn));
-
-        child->rows[idx] = r;
-        child->cols[idx] = c;
-        child->fields[row * BOARD_SIZE + col] = -1;
-        child->fields[r * BOARD_SIZE + c] = idx;
-
-        root->childs[root->childSize - 1] = child;
-        child->parent = root;
     }
 }
 
-// expands MCTS tree
-__host__ void expandNode(node* root)
+// collects all moves available in game state
+__host__ void expandMoves(moveList* moves, node* root)
 {
     if (root->lastKill >= 0)
     {
 
         if (root->isQueen[root->lastKill])
         {
-            expandForQueenKill(root->fields, root->rows[root->lastKill], root->cols[root->lastKill], root->lastKill, root, false);
+            expandForQueenKill(moves, root->fields, root->rows[root->lastKill], root->cols[root->lastKill], root->lastKill, false);
         }
         else
         {
-            expandForPawnKills(root->fields, root->rows[root->lastKill], root->cols[root->lastKill], root->lastKill, true, root, false);
-            expandForPawnKills(root->fields, root->rows[root->lastKill], root->cols[root->lastKill], root->lastKill, false, root, false);
+            expandForPawnKills(moves, root->fields, root->rows[root->lastKill], root->cols[root->lastKill], root->lastKill, true, false);
+            expandForPawnKills(moves, root->fields, root->rows[root->lastKill], root->cols[root->lastKill], root->lastKill, false, false);
         }
         return;
 
@@ -1450,12 +1885,12 @@ __host__ void expandNode(node* root)
         {
             if (root->isQueen[i] && hasQueenKill(root->fields, root->rows[i], root->cols[i], i))
             {
-                expandForQueenKill(root->fields, root->rows[i], root->cols[i], i, root);
+                expandForQueenKill(moves, root->fields, root->rows[i], root->cols[i], i);
                 isThereKill = true;
             }
             else if (hasKill(root->fields, i, root->rows, root->cols))
             {
-                expandForPawnKills(root->fields, root->rows[i], root->cols[i], i, !(root->blackTurn), root);
+                expandForPawnKills(moves, root->fields, root->rows[i], root->cols[i], i, !(root->blackTurn));
                 isThereKill = true;
             }
         }
@@ -1469,39 +1904,16 @@ __host__ void expandNode(node* root)
         {
             if (root->isQueen[i])
             {
-                expandForQueenMoves(root->rows[i], root->cols[i], i, root->fields, root);
+                expandForQueenMoves(moves, root->fields, root->rows[i], root->cols[i], i);
             }
             else
             {
-                expandForPawnMoves(root->rows[i], root->cols[i], i, root->fields, root);
+                expandForPawnMoves(moves, root, root->rows[i], root->cols[i], i);
             }
         }
     }
 }
 
-// calculate upper confidence boundary value of node
-__host__ float getUCBValue(node* parent, node* child)
-{
-    if (child->howManyVisits == 0) return INFINITY;
-    return (float)(child->avgReward + 2 * sqrt(log(parent->howManyVisits) / (float)child->howManyVisits));
-}
-
-// frees memory allocated to node
-__host__ void freeNode(node* root)
-{
-    delete[] root->fields;
-    delete[] root->rows;
-    delete[] root->cols;
-    delete[] root->isQueen;
-
-    for (int i = 0; i < root->childSize; i++)
-        delete root->childs[i];
-
-    if (root->childs != nullptr)
-        delete[] root->childs;
-    delete root;
-}
-
 // evaluates current position of player on checkboard
 // inspired by wischk checkers program evalutaion function
 // http://people.cs.uchicago.edu/~wiseman/checkers/
@@ -1589,49 +2001,1290 @@ __host__ __device__ float evaluatePositionValue(int* rows, int* cols, bool* isQu
     return tscore * (blackEval ? 1 : -1);
 }
 
-// sum reduce
-template <unsigned int blockSize>
-__device__ void warpReduce(volatile float* sdata, unsigned int tid) {
-    if (blockSize >= 64) sdata[tid] += sdata[tid + 32];
-    if (blockSize >= 32) sdata[tid] += sdata[tid + 16];
-    if (blockSize >= 16) sdata[tid] += sdata[tid + 8];
-    if (blockSize >= 8) sdata[tid] += sdata[tid + 4];
-    if (blockSize >= 4) sdata[tid] += sdata[tid + 2];
-    if (blockSize >= 2) sdata[tid] += sdata[tid + 1];
+// performs move of edge leading to node on game state of its parent
+__host__ void applyMove(node* state, edgeMove move)
+{
+    int idx = move.pawn;
+    int row = state->rows[idx];
+    int col = state->cols[idx];
+    state->rows[idx] = move.row;
+    state->cols[idx] = move.col;
+    if (move.flags & MOVE_KILL)
+        removePawn(trackPawnToRemove(row, col, move.row, move.col, state->fields), state->rows, state->cols, state->fields);
+
+    state->fields[row * BOARD_SIZE + col] = -1;
+    state->fields[move.row * BOARD_SIZE + move.col] = idx;
+
+    state->lastKill = -1;
+    if ((move.flags & MOVE_KILL) && (state->isQueen[idx] ? hasQueenKill(state->fields, move.row, move.col, idx) : hasKill(state->fields, idx, state->rows, state->cols, true)))
+        state->lastKill = idx;
+
+    if ((idx < PAWN_ROWS * BOARD_SIZE / 2 && move.row == BOARD_SIZE - 1)
+        || (idx >= PAWN_ROWS * BOARD_SIZE / 2 && move.row == 0))
+    {
+        if (!state->isQueen[idx])
+            state->lastKill = -1;
+        state->isQueen[idx] = true;
+    }
+    if (move.flags & MOVE_CHANGE_TURN)
+        state->blackTurn = !state->blackTurn;
 }
 
-// performs copying node from dynamic memory node to static one
-void copyToFixedNode(node* root, fixedNode* fixed)
+// sorts moves by value of game state after them from perspective of player making them, best first
+__host__ void orderMoves(moveList* moves, node* root)
 {
-    for (int i = 0; i < PAWN_ROWS * BOARD_SIZE; i++)
+    std::pair<float, int> order[MAX_CHILDREN];
+    for (int i = 0; i < moves->size; i++)
     {
-        fixed->cols[i] = root->cols[i];
-        fixed->rows[i] = root->rows[i];
-        fixed->isQueen[i] = root->isQueen[i];
+        node child = *root;
+        applyMove(&child, moves->moves[i]);
+        order[i] = { -evaluatePositionValue(child.rows, child.cols, child.isQueen, root->blackTurn), i };
     }
-    for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+    std::stable_sort(order, order + moves->size);
+    edgeMove sorted[MAX_CHILDREN];
+    for (int i = 0; i < moves->size; i++)
+        sorted[i] = moves->moves[order[i].second];
+    memcpy(moves->moves, sorted, moves->size * sizeof(edgeMove));
+}
+
+// gives priors of moves as softmax over value of game state after them from perspective of player making them
+__host__ void getEvaluationPriors(moveList* moves, node* root, float* priors)
+{
+    float maxValue = -INFINITY;
+    for (int i = 0; i < moves->size; i++)
     {
-        fixed->fields[i] = root->fields[i];
+        node child = *root;
+        applyMove(&child, moves->moves[i]);
+        priors[i] = evaluatePositionValue(child.rows, child.cols, child.isQueen, root->blackTurn) / PUCT_TEMPERATURE;
+        maxValue = fmaxf(maxValue, priors[i]);
     }
+    float sum = 0;
+    for (int i = 0; i < moves->size; i++)
+        sum += (priors[i] = expf(priors[i] - maxValue));
+    for (int i = 0; i < moves->size; i++)
+        priors[i] /= sum;
 }
 
-// performs sequential random moves and evaluates position afterwards
-template <unsigned int blockSize>
-__global__ void d_runSimulation(fixedNode* root, float* rewards, bool blackTurn, int lastKill, bool blackEval, int g_numOfWhite, int g_numOfBlack)
+// expands MCTS tree, root is game state of node with given index,
+// children become visible to other threads once child size is stored,
+// returns false if arena is full and node can be expanded again later
+__host__ bool expandNode(nodeArena* arena, int rootIdx, node* root)
 {
-    extern __shared__ volatile float sumRewards[MAX_BLOCK];
-    unsigned int tid = threadIdx.x;
-    int fields[BOARD_SIZE * BOARD_SIZE];
-    int rows[PAWN_ROWS * BOARD_SIZE];
-    int cols[PAWN_ROWS * BOARD_SIZE];
-    bool isQueen[PAWN_ROWS * BOARD_SIZE];
-
-    curandState state;
-
-    curand_init(clock64(), tid, 0, &state);
+    moveList moves;
+    moves.size = 0;
+    expandMoves(&moves, root);
+
+    if (PROGRESSIVE_WIDENING && moves.size > 1)
+        orderMoves(&moves, root);
+#if PUCT
+    float priors[MAX_CHILDREN];
+    PUCT_PRIORS(&moves, root, priors);
+#endif
+
+    if (moves.size > 0)
+    {
+        int firstChild = allocNodes(arena, moves.size);
+        if (firstChild < 0)
+        {
+            nodeFlags(arena, rootIdx) &= ~NODE_EXPANDING;
+            return false;
+        }
+        for (int i = 0; i < moves.size; i++)
+        {
+            edgeMove move = moves.moves[i];
+            bool blackTurn = (move.flags & MOVE_CHANGE_TURN) ? !root->blackTurn : root->blackTurn;
+            initNode(arena, firstChild + i, rootIdx, blackTurn, move.pawn >= PAWN_ROWS * BOARD_SIZE / 2);
+            getChunk(arena, firstChild + i)->move[NODE_OFFSET(firstChild + i)] = move;
+#if PUCT
+            getChunk(arena, firstChild + i)->prior[NODE_OFFSET(firstChild + i)] = priors[i];
+#endif
+        }
+        nodeFirstChild(arena, rootIdx) = firstChild;
+        nodeChildSize(arena, rootIdx).store(moves.size, std::memory_order_release);
+    }
+    nodeFlags(arena, rootIdx) |= NODE_EXPANDED;
+    return true;
+}
+
+// claims expansion of node, only one thread succeeds
+__host__ bool claimExpansion(nodeArena* arena, int idx)
+{
+    return (nodeFlags(arena, idx).fetch_or(NODE_EXPANDING) & NODE_EXPANDING) == 0;
+}
+
+// gets game state of child by applying its move on game state of parent,
+// states of well visited nodes are kept in arena so they are built only once, state is returned in scratch
+__host__ node* descendToChild(nodeArena* arena, int childIdx, node* parentState, node* scratch)
+{
+    nodeChunk* chunk = getChunk(arena, childIdx);
+    int offset = NODE_OFFSET(childIdx);
+    int position = chunk->position[offset].load(std::memory_order_acquire);
+    if (position >= 0)
+        return loadPosition(arena, position, scratch);
+
+    if (parentState != scratch)
+        memcpy(scratch, parentState, sizeof(node));
+    applyMove(scratch, chunk->move[offset]);
+    if (scratch->lastKill >= 0 && !(chunk->flags[offset] & NODE_CHAIN_KILL))
+        chunk->flags[offset] |= NODE_CHAIN_KILL;
+
+    if (chunk->visits[offset] >= POSITION_CACHE_VISITS)
+    {
+        // state stored by thread which lost race is never used
+        int expected = -1;
+        if ((position = storePosition(arena, scratch)) >= 0)
+            chunk->position[offset].compare_exchange_strong(expected, position, std::memory_order_acq_rel);
+    }
+    return scratch;
+}
+
+// unpacks game state kept in arena whose loading was put off during descent, returns state of node
+__host__ node* resolvePosition(nodeArena* arena, int* position, node* state, node* scratch)
+{
+    if (*position < 0)
+        return state;
+    loadPosition(arena, *position, scratch);
+    *position = -1;
+    return scratch;
+}
+
+// checks if simulations of player are run on host
+__host__ bool isHostPlayer(int player)
+{
+#ifndef __CUDACC__
+    return true;
+#endif
+    return (player == PLAYER_ONE && !PARALLEL_PLAYER_ONE) || (player == PLAYER_TWO && !PARALLEL_PLAYER_TWO);
+}
+
+// number of threads used for search, 0 stands for all cores
+__host__ int getThreadCount(int configured)
+{
+    if (configured > 0)
+        return configured;
+    return max(1, (int)std::thread::hardware_concurrency());
+}
+
+// number of trees grown at once on host
+__host__ int getRootThreads()
+{
+    return getThreadCount(ROOT_PARALLEL_THREADS);
+}
+
+// number of threads sharing main tree of player
+__host__ int getTreeThreads(int player)
+{
+    if (!isHostPlayer(player))
+        return 1;
+    return getThreadCount(TREE_PARALLEL_THREADS);
+}
+
+// adds visits counted as lost simulations so that other threads prefer different paths
+__host__ void addVirtualLoss(nodeArena* arena, int idx)
+{
+    nodeVisits(arena, idx) += VIRTUAL_LOSS;
+    addReward(nodeRewardSum(arena, idx), -VIRTUAL_LOSS * VIRTUAL_LOSS_REWARD);
+}
+
+// sets limits of search of player started at given time on tree in arena
+__host__ void initSearchBudget(searchBudget* budget, int player, nodeArena* arena, std::chrono::high_resolution_clock::time_point start)
+{
+    int iterations = (player == PLAYER_ONE ? TREE_ITER_ONE : TREE_ITER_TWO);
+    int moveTime = (player == PLAYER_ONE ? MOVE_TIME_ONE : MOVE_TIME_TWO);
+    budget->iterations = iterations > 0 ? iterations : INT_MAX;
+    budget->simulations = 0;
+    budget->stopped = false;
+    budget->hasDeadline = moveTime > 0;
+    budget->deadline = start + std::chrono::milliseconds(moveTime);
+    budget->nodesStart = arena->size;
+    budget->maxNodes = (player == PLAYER_ONE ? MAX_NODES_ONE : MAX_NODES_TWO);
+    budget->maxSimulations = (player == PLAYER_ONE ? MAX_SIMULATIONS_ONE : MAX_SIMULATIONS_TWO);
+    budget->solved = false;
+    budget->shared = nullptr;
+}
+
+// checks if time or simulations of search ran out, cheap enough to be called between simulation batches
+__host__ bool budgetExhausted(searchBudget* budget)
+{
+    if (budget->stopped.load(std::memory_order_relaxed))
+        return true;
+    if (budget->shared != nullptr && budget->shared->solved.load(std::memory_order_relaxed))
+        return true;
+    if (budget->maxSimulations > 0 && budget->simulations.load(std::memory_order_relaxed) >= budget->maxSimulations)
+        return true;
+    return budget->hasDeadline && std::chrono::high_resolution_clock::now() >= budget->deadline;
+}
+
+// takes one iteration from budget, once any of limits is reached search is stopped for all threads
+__host__ bool takeIteration(searchBudget* budget, nodeArena* arena)
+{
+    if (budgetExhausted(budget)
+        || (budget->maxNodes > 0 && arena->size - budget->nodesStart >= budget->maxNodes)
+        || budget->iterations.fetch_sub(1) <= 0)
+    {
+        budget->stopped = true;
+        return false;
+    }
+    return true;
+}
+
+// stops search run on opponent's time and waits for it and for compaction of tree to finish
+__host__ void stopBackgroundWork(searchTree* tree)
+{
+    if (!tree->backgroundThread.joinable())
+        return;
+    tree->ponderBudget.stopped = true;
+    tree->backgroundThread.join();
+}
+
+// inits empty tree of player
+__host__ searchTree* initSearchTree()
+{
+    searchTree* tree = new searchTree;
+    tree->memory.bytes = 0;
+    tree->memory.peakBytes = 0;
+    tree->arena = initArena(&tree->memory);
+    tree->spare = initArena(&tree->memory);
+    tree->lastMove = -1;
+    tree->ponderStats = {};
+    tree->ponderRoot = -1;
+    tree->visitsPondered = 0;
+    tree->numOfWorkers = getRootThreads() - 1;
+    tree->workers = new nodeArena*[tree->numOfWorkers];
+    for (int i = 0; i < tree->numOfWorkers; i++)
+        tree->workers[i] = initArena(&tree->memory);
+    return tree;
+}
+
+// frees memory allocated to tree
+__host__ void freeSearchTree(searchTree* tree)
+{
+    stopBackgroundWork(tree);
+    freeArena(tree->arena);
+    freeArena(tree->spare);
+    for (int i = 0; i < tree->numOfWorkers; i++)
+        freeArena(tree->workers[i]);
+    delete[] tree->workers;
+    delete tree;
+}
+
+// copies statistics, move and game state of node between arenas
+__host__ void copyNode(nodeArena* from, int fromIdx, nodeArena* to, int toIdx, int toParent)
+{
+    nodeChunk* fromChunk = getChunk(from, fromIdx);
+    nodeChunk* toChunk = getChunk(to, toIdx);
+    int fromOffset = NODE_OFFSET(fromIdx);
+    int toOffset = NODE_OFFSET(toIdx);
+    toChunk->visits[toOffset] = fromChunk->visits[fromOffset].load();
+    toChunk->rewardSum[toOffset] = fromChunk->rewardSum[fromOffset].load();
+    toChunk->firstChild[toOffset] = -1;
+    toChunk->childSize[toOffset] = 0;
+    toChunk->parent[toOffset] = toParent;
+    toChunk->flags[toOffset] = fromChunk->flags[fromOffset].load();
+    toChunk->move[toOffset] = fromChunk->move[fromOffset];
+    toChunk->position[toOffset] = -1;
+#if PUCT
+    toChunk->prior[toOffset] = fromChunk->prior[fromOffset];
+#endif
+#if RAVE
+    toChunk->amafVisits[toOffset] = fromChunk->amafVisits[fromOffset].load();
+    toChunk->amafRewardSum[toOffset] = fromChunk->amafRewardSum[fromOffset].load();
+#endif
+    if (fromChunk->position[fromOffset] >= 0)
+        toChunk->position[toOffset] = storePackedPosition(to, getPosition(from, fromChunk->position[fromOffset]));
+}
+
+// copies subtree of node into empty arena level by level, returns index of its root there
+__host__ int copySubtree(nodeArena* from, int rootIdx, nodeArena* to)
+{
+    int* fromQueue = new int[from->size];
+    int* toQueue = new int[from->size];
+    int queueStart = 0, queueEnd = 0;
+
+    int newRootIdx = allocNodes(to, 1);
+    if (newRootIdx < 0)
+    {
+        delete[] fromQueue;
+        delete[] toQueue;
+        return -1;
+    }
+    copyNode(from, rootIdx, to, newRootIdx, -1);
+    fromQueue[queueEnd] = rootIdx;
+    toQueue[queueEnd++] = newRootIdx;
+
+    while (queueStart < queueEnd)
+    {
+        int fromIdx = fromQueue[queueStart];
+        int toIdx = toQueue[queueStart++];
+        int childSize = nodeChildSize(from, fromIdx);
+        // shared children are copied only under node owning them
+        if (nodeFlags(to, toIdx) & NODE_LINKED)
+        {
+            nodeFlags(to, toIdx) &= ~(NODE_LINKED | NODE_EXPANDING | NODE_EXPANDED);
+            continue;
+        }
+        if (childSize == 0)
+            continue;
+        int firstChild = allocNodes(to, childSize);
+        if (firstChild < 0)
+        {
+            nodeFlags(to, toIdx) &= ~(NODE_EXPANDING | NODE_EXPANDED);
+            continue;
+        }
+        for (int i = 0; i < childSize; i++)
+        {
+            copyNode(from, nodeFirstChild(from, fromIdx) + i, to, firstChild + i, toIdx);
+            fromQueue[queueEnd] = nodeFirstChild(from, fromIdx) + i;
+            toQueue[queueEnd++] = firstChild + i;
+        }
+        nodeFirstChild(to, toIdx) = firstChild;
+        nodeChildSize(to, toIdx) = childSize;
+    }
+
+    delete[] fromQueue;
+    delete[] toQueue;
+    return newRootIdx;
+}
+
+// looks for node with given game state among replies to node, kill chains are followed to their end
+__host__ int findReply(nodeArena* arena, int idx, node* state, int* fields, bool* isQueen, bool blackTurn)
+{
+    node scratch;
+    for (int i = 0; i < nodeChildSize(arena, idx); i++)
+    {
+        int childIdx = nodeFirstChild(arena, idx) + i;
+        node* childState = descendToChild(arena, childIdx, state, &scratch);
+        if (childState->lastKill >= 0)
+        {
+            int replyIdx = findReply(arena, childIdx, childState, fields, isQueen, blackTurn);
+            if (replyIdx >= 0)
+                return replyIdx;
+        }
+        else if (childState->blackTurn == blackTurn
+            && memcmp(childState->fields, fields, BOARD_SIZE * BOARD_SIZE * sizeof(int)) == 0
+            && memcmp(childState->isQueen, isQueen, PAWN_ROWS * BOARD_SIZE * sizeof(bool)) == 0)
+        {
+            if (nodePosition(arena, childIdx) < 0)
+                nodePosition(arena, childIdx) = storePosition(arena, childState);
+            return childIdx;
+        }
+    }
+    return -1;
+}
+
+// releases children of node and all their descendants with game states, node becomes leaf keeping its statistics
+__host__ int releaseSubtree(nodeArena* arena, int idx)
+{
+    // first child and size of blocks waiting to be released
+    int* blocks = arena->recycleBlocks;
+    int released = 0;
+    int numOfBlocks = 1;
+    blocks[0] = nodeFirstChild(arena, idx);
+    blocks[1] = nodeChildSize(arena, idx);
+    while (numOfBlocks > 0)
+    {
+        numOfBlocks--;
+        int firstChild = blocks[2 * numOfBlocks];
+        int childSize = blocks[2 * numOfBlocks + 1];
+        for (int i = 0; i < childSize; i++)
+        {
+            int childIdx = firstChild + i;
+            if (nodeChildSize(arena, childIdx) > 0)
+            {
+                blocks[2 * numOfBlocks] = nodeFirstChild(arena, childIdx);
+                blocks[2 * numOfBlocks + 1] = nodeChildSize(arena, childIdx);
+                numOfBlocks++;
+            }
+            if (nodePosition(arena, childIdx) >= 0)
+                releasePosition(arena, nodePosition(arena, childIdx));
+        }
+        releaseNodes(arena, firstChild, childSize);
+        released += childSize;
+    }
+    nodeFirstChild(arena, idx) = -1;
+    nodeChildSize(arena, idx) = 0;
+    nodeFlags(arena, idx) &= ~(NODE_EXPANDING | NODE_EXPANDED);
+    return released;
+}
+
+// releases all nodes of arena which aren't in subtree of node, except its ancestors and their children
+__host__ void releaseOffSubtree(nodeArena* arena, int idx)
+{
+    for (; nodeParent(arena, idx) >= 0; idx = nodeParent(arena, idx))
+    {
+        int parentIdx = nodeParent(arena, idx);
+        for (int i = 0; i < nodeChildSize(arena, parentIdx); i++)
+        {
+            int siblingIdx = nodeFirstChild(arena, parentIdx) + i;
+            if (siblingIdx == idx)
+                continue;
+            if (nodeChildSize(arena, siblingIdx) > 0)
+                releaseSubtree(arena, siblingIdx);
+            if (nodePosition(arena, siblingIdx) >= 0)
+            {
+                releasePosition(arena, nodePosition(arena, siblingIdx));
+                nodePosition(arena, siblingIdx) = -1;
+            }
+        }
+    }
+    coalesceFreeNodes(arena);
+}
+
+// checks if nodes of tree of player can be released, which is safe only when it's grown by single thread
+__host__ bool canReleaseNodes(int player)
+{
+    return TREE_RECYCLE && !TRANSPOSITIONS && getTreeThreads(player) == 1;
+}
+
+// copies subtree of last move of player into spare arena which becomes tree of player,
+// old arena is dropped by reset and its chunks are freed under memory limit so that next copy fits,
+// if root of copy doesn't fit tree is kept in place with nodes off it released when that's safe,
+// otherwise lastMove becomes -1
+__host__ void compactTree(searchTree* tree, int player)
+{
+    // tree loaded from snapshot is rooted at last move already
+    if (tree->lastMove >= 0 && nodeParent(tree->arena, tree->lastMove) < 0)
+        return;
+    int rootIdx = copySubtree(tree->arena, tree->lastMove, tree->spare);
+    if ((rootIdx < 0 || nodePosition(tree->spare, rootIdx) < 0) && canReleaseNodes(player)
+        && tree->lastMove >= 0 && nodePosition(tree->arena, tree->lastMove) >= 0)
+    {
+        resetArena(tree->spare);
+        if (TREE_MEMORY_LIMIT > 0)
+            trimArena(tree->spare);
+        releaseOffSubtree(tree->arena, tree->lastMove);
+        return;
+    }
+    nodeArena* arena = tree->arena;
+    tree->arena = tree->spare;
+    tree->spare = arena;
+    resetArena(tree->spare);
+    if (TREE_MEMORY_LIMIT > 0)
+        trimArena(tree->spare);
+    tree->lastMove = rootIdx >= 0 && nodePosition(tree->arena, rootIdx) >= 0 ? rootIdx : -1;
+}
+
+// promotes node reached by opponent reply to root of tree in place, returns index of root
+// or -1 if reply wasn't explored in previous search, other replies are released when release is set,
+// otherwise they stay in arena until tree is compacted after move
+__host__ int reuseSubtree(searchTree* tree, int* fields, bool* isQueen, bool blackTurn, bool release)
+{
+    int lastMove = tree->lastMove;
+    tree->lastMove = -1;
+    tree->visitsPondered = 0;
+    if (lastMove < 0)
+        return -1;
+    node lastState;
+    loadPosition(tree->arena, nodePosition(tree->arena, lastMove), &lastState);
+    int replyIdx = findReply(tree->arena, lastMove, &lastState, fields, isQueen, blackTurn);
+    if (replyIdx < 0)
+        return -1;
+    if (tree->ponderRoot == lastMove)
+    {
+        // reply ending kill chain is counted against child of pondering root starting it,
+        // which had at least as many visits, so visits pondered are never overstated
+        int childIdx = replyIdx;
+        while (nodeParent(tree->arena, childIdx) >= 0 && nodeParent(tree->arena, childIdx) != lastMove)
+            childIdx = nodeParent(tree->arena, childIdx);
+        if (nodeParent(tree->arena, childIdx) == lastMove)
+            tree->visitsPondered = max(0, nodeVisits(tree->arena, replyIdx)
+                - tree->ponderStartVisits[childIdx - nodeFirstChild(tree->arena, lastMove)]);
+    }
+    if (release)
+        releaseOffSubtree(tree->arena, replyIdx);
+    nodeParent(tree->arena, replyIdx) = -1;
+    return replyIdx;
+}
+
+// moves chunks of arena kept in mapped snapshot file to heap so that file can be replaced
+__host__ void detachSnapshot(nodeArena* arena)
+{
+    if (arena->snapshot == nullptr)
+        return;
+    for (int i = 0; i < ARENA_MAX_CHUNKS; i++)
+    {
+        if (isSnapshotChunk(arena, arena->chunks[i].load()))
+        {
+            nodeChunk* chunk = allocateNodeChunk();
+            memcpy((void*)chunk, (void*)arena->chunks[i].load(), sizeof(nodeChunk));
+            arena->chunks[i] = chunk;
+        }
+        if (isSnapshotChunk(arena, arena->positionChunks[i].load()))
+        {
+            packedPosition* chunk = allocatePositionChunk();
+            memcpy(chunk, arena->positionChunks[i].load(), ARENA_CHUNK_SIZE * sizeof(packedPosition));
+            arena->positionChunks[i] = chunk;
+        }
+    }
+    unmapFile(arena->snapshot, arena->snapshotBytes);
+    arena->snapshot = nullptr;
+    arena->snapshotBytes = 0;
+}
+
+// fills header of snapshot with layout of chunks of this build
+__host__ void initSnapshotHeader(snapshotHeader* header)
+{
+    memset(header, 0, sizeof(snapshotHeader));
+    memcpy(header->magic, "MCTSTREE", sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->chunkSize = ARENA_CHUNK_SIZE;
+    header->nodeChunkBytes = sizeof(nodeChunk);
+    header->positionBytes = sizeof(packedPosition);
+}
+
+// bytes of snapshot file of tree with given number of nodes and game states
+__host__ long long getSnapshotBytes(int size, int numOfPositions)
+{
+    long long nodeChunks = (size + ARENA_CHUNK_SIZE - 1) >> ARENA_CHUNK_SHIFT;
+    long long positionChunks = (numOfPositions + ARENA_CHUNK_SIZE - 1) >> ARENA_CHUNK_SHIFT;
+    return SNAPSHOT_ALIGNMENT + nodeChunks * sizeof(nodeChunk) + positionChunks * ARENA_CHUNK_SIZE * sizeof(packedPosition);
+}
+
+// writes tree of player to file, indices of nodes don't depend on where chunks are so they are written
+// as they are, work on tree in background is stopped, returns false if there's no tree to resume from
+// or game has moved on from last move of player
+__host__ bool saveSearchTree(searchTree* tree, int player, int* fields, bool* isQueen, bool blackTurn, const char* path)
+{
+    stopBackgroundWork(tree);
+    if (tree->lastMove < 0)
+        return false;
+    node state;
+    loadPosition(tree->arena, nodePosition(tree->arena, tree->lastMove), &state);
+    if (state.blackTurn != blackTurn || memcmp(state.fields, fields, BOARD_SIZE * BOARD_SIZE * sizeof(int)) != 0
+        || memcmp(state.isQueen, isQueen, PAWN_ROWS * BOARD_SIZE * sizeof(bool)) != 0)
+        return false;
+    // file can't be replaced on some systems while it's mapped
+    detachSnapshot(tree->arena);
+    detachSnapshot(tree->spare);
+    nodeArena* arena = tree->arena;
+    snapshotHeader header;
+    initSnapshotHeader(&header);
+    header.player = player;
+    header.lastMove = tree->lastMove;
+    header.size = arena->size;
+    header.numOfPositions = arena->numOfPositions;
+    memcpy(header.freeBlocks, arena->freeBlocks, sizeof(header.freeBlocks));
+    header.freeNodes = arena->freeNodes;
+    header.freePosition = arena->freePosition;
+    header.freePositions = arena->freePositions;
+
+    ofstream output;
+    output.open(path, ios::binary | ios::trunc);
+    if (!output.is_open())
+        return false;
+    char padding[SNAPSHOT_ALIGNMENT] = {};
+    output.write((char*)&header, sizeof(header));
+    output.write(padding, SNAPSHOT_ALIGNMENT - sizeof(header));
+    for (int i = 0; i < (header.size + ARENA_CHUNK_SIZE - 1) >> ARENA_CHUNK_SHIFT; i++)
+        output.write((char*)arena->chunks[i].load(), sizeof(nodeChunk));
+    for (int i = 0; i < (header.numOfPositions + ARENA_CHUNK_SIZE - 1) >> ARENA_CHUNK_SHIFT; i++)
+        output.write((char*)arena->positionChunks[i].load(), ARENA_CHUNK_SIZE * sizeof(packedPosition));
+    output.close();
+    return !output.fail();
+}
+
+// checks if mapped file is snapshot of tree of player saved by this build and its header refers only to nodes
+// and game states within file
+__host__ bool isValidSnapshot(char* snapshot, long long bytes, int player)
+{
+    snapshotHeader* header = (snapshotHeader*)snapshot;
+    snapshotHeader expected;
+    initSnapshotHeader(&expected);
+    if (bytes < SNAPSHOT_ALIGNMENT || memcmp(header->magic, expected.magic, sizeof(expected.magic)) != 0
+        || header->version != expected.version || header->chunkSize != expected.chunkSize
+        || header->nodeChunkBytes != expected.nodeChunkBytes || header->positionBytes != expected.positionBytes
+        || header->player != player || header->size < 0 || header->numOfPositions < 0
+        || header->size > ARENA_MAX_CHUNKS * ARENA_CHUNK_SIZE || header->numOfPositions > ARENA_MAX_CHUNKS * ARENA_CHUNK_SIZE
+        || header->lastMove < 0 || header->lastMove >= header->size
+        || bytes != getSnapshotBytes(header->size, header->numOfPositions))
+        return false;
+    int position = ((nodeChunk*)(snapshot + SNAPSHOT_ALIGNMENT))[header->lastMove >> ARENA_CHUNK_SHIFT].position[NODE_OFFSET(header->lastMove)];
+    if (position < 0 || position >= header->numOfPositions)
+        return false;
+    // only heads of free lists are checked, blocks further down them are linked by released nodes in file
+    for (int i = 0; i <= MAX_CHILDREN; i++)
+        if (header->freeBlocks[i] < -1 || (header->freeBlocks[i] >= 0 && header->freeBlocks[i] + i > header->size))
+            return false;
+    return header->freeNodes >= 0 && header->freeNodes <= header->size
+        && header->freePosition >= -1 && header->freePosition < header->numOfPositions
+        && header->freePositions >= 0 && header->freePositions <= header->numOfPositions;
+}
+
+// maps tree saved by player to memory and makes it tree of player, chunks point into file
+// so nothing is read until search gets to it, returns false if file isn't snapshot of this build
+__host__ bool loadSearchTree(searchTree* tree, int player, const char* path)
+{
+    long long bytes;
+    char* snapshot = mapFile(path, &bytes);
+    if (snapshot == nullptr)
+        return false;
+    snapshotHeader* header = (snapshotHeader*)snapshot;
+    if (!isValidSnapshot(snapshot, bytes, player))
+    {
+        unmapFile(snapshot, bytes);
+        return false;
+    }
+
+    stopBackgroundWork(tree);
+    freeArena(tree->arena);
+    nodeArena* arena = tree->arena = initArena(&tree->memory);
+    arena->snapshot = snapshot;
+    arena->snapshotBytes = bytes;
+    char* data = snapshot + SNAPSHOT_ALIGNMENT;
+    for (int i = 0; i < (header->size + ARENA_CHUNK_SIZE - 1) >> ARENA_CHUNK_SHIFT; i++, data += sizeof(nodeChunk))
+    {
+        arena->chunks[i] = (nodeChunk*)data;
+        arena->numOfChunks++;
+    }
+    for (int i = 0; i < (header->numOfPositions + ARENA_CHUNK_SIZE - 1) >> ARENA_CHUNK_SHIFT; i++, data += ARENA_CHUNK_SIZE * sizeof(packedPosition))
+    {
+        arena->positionChunks[i] = (packedPosition*)data;
+        arena->numOfPositionChunks++;
+    }
+    reserveBytes(arena, (long long)arena->numOfChunks * sizeof(nodeChunk)
+        + (long long)arena->numOfPositionChunks * ARENA_CHUNK_SIZE * sizeof(packedPosition), true);
+    arena->size = header->size;
+    arena->numOfPositions = header->numOfPositions;
+    memcpy(arena->freeBlocks, header->freeBlocks, sizeof(arena->freeBlocks));
+    arena->freeNodes = header->freeNodes;
+    arena->freePosition = header->freePosition;
+    arena->freePositions = header->freePositions;
+    tree->lastMove = header->lastMove;
+    tree->ponderRoot = -1;
+    return true;
+}
+
+// gets game state reached by last move of player whose tree it is
+__host__ void getLastMovePosition(searchTree* tree, int* fields, int* rows, int* cols, bool* isQueen, bool* blackTurn)
+{
+    node state;
+    loadPosition(tree->arena, nodePosition(tree->arena, tree->lastMove), &state);
+    memcpy(fields, state.fields, BOARD_SIZE * BOARD_SIZE * sizeof(int));
+    memcpy(rows, state.rows, PAWN_ROWS * BOARD_SIZE * sizeof(int));
+    memcpy(cols, state.cols, PAWN_ROWS * BOARD_SIZE * sizeof(int));
+    memcpy(isQueen, state.isQueen, PAWN_ROWS * BOARD_SIZE * sizeof(bool));
+    *blackTurn = state.blackTurn;
+}
+
+// counts nodes in subtree of node, node included
+__host__ int countSubtree(nodeArena* arena, int rootIdx)
+{
+    int* stack = arena->recycleStack;
+    int stackSize = 0;
+    int count = 1;
+    stack[stackSize++] = rootIdx;
+    while (stackSize > 0)
+    {
+        int idx = stack[--stackSize];
+        count += nodeChildSize(arena, idx);
+        for (int i = 0; i < nodeChildSize(arena, idx); i++)
+            if (nodeChildSize(arena, nodeFirstChild(arena, idx) + i) > 0)
+                stack[stackSize++] = nodeFirstChild(arena, idx) + i;
+    }
+    return count;
+}
+
+// releases subtrees of least visited nodes off principal variation and path of current iteration
+// until TREE_RECYCLE_SHARE of nodes under root is freed, visits threshold is doubled after each pass,
+// can be used only when tree is grown by single thread, returns number of released nodes
+__host__ int recycleNodes(nodeArena* arena, int rootIdx, int* path, int depth)
+{
+    // principal variation follows most visited children
+    int principal[MAX_TREE_DEPTH];
+    int principalDepth = 0;
+    for (int idx = rootIdx; principalDepth < MAX_TREE_DEPTH; )
+    {
+        principal[principalDepth++] = idx;
+        nodeFlags(arena, idx) |= NODE_KEEP;
+        int childSize = nodeChildSize(arena, idx);
+        if (childSize == 0)
+            break;
+        int firstChild = nodeFirstChild(arena, idx);
+        idx = firstChild;
+        for (int i = 1; i < childSize; i++)
+            if (nodeVisits(arena, firstChild + i) > nodeVisits(arena, idx))
+                idx = firstChild + i;
+    }
+    for (int i = 0; i < depth; i++)
+        nodeFlags(arena, path[i]) |= NODE_KEEP;
+
+    int* stack = arena->recycleStack;
+    int target = (int)(countSubtree(arena, rootIdx) * TREE_RECYCLE_SHARE);
+    int released = 0;
+    long long rootVisits = nodeVisits(arena, rootIdx);
+    for (long long threshold = 1; released < target; threshold *= 2)
+    {
+        int stackSize = 0;
+        stack[stackSize++] = rootIdx;
+        while (stackSize > 0 && released < target)
+        {
+            int idx = stack[--stackSize];
+            if (!(nodeFlags(arena, idx) & NODE_KEEP) && nodeVisits(arena, idx) <= threshold)
+            {
+                released += releaseSubtree(arena, idx);
+                continue;
+            }
+            for (int i = 0; i < nodeChildSize(arena, idx); i++)
+                if (nodeChildSize(arena, nodeFirstChild(arena, idx) + i) > 0)
+                    stack[stackSize++] = nodeFirstChild(arena, idx) + i;
+        }
+        if (threshold >= rootVisits)
+            break;
+    }
+
+    for (int i = 0; i < principalDepth; i++)
+        nodeFlags(arena, principal[i]) &= ~NODE_KEEP;
+    for (int i = 0; i < depth; i++)
+        nodeFlags(arena, path[i]) &= ~NODE_KEEP;
+    coalesceFreeNodes(arena);
+    return released;
+}
+
+// remembers expanded node as owner of children of its game state
+__host__ void storeTransposition(nodeArena* arena, int idx, node* state)
+{
+    if (state->lastKill >= 0 || nodeChildSize(arena, idx) == 0)
+        return;
+    if (nodePosition(arena, idx) < 0 && (nodePosition(arena, idx) = storePosition(arena, state)) < 0)
+        return;
+    unsigned long long hash = hashPosition(state->fields, state->isQueen, state->blackTurn, state->lastKill);
+    transpositionEntry* entry = &arena->transpositions[hash & (TRANSPOSITION_TABLE_SIZE - 1)];
+    entry->hash = hash;
+    entry->idx = idx;
+    entry->generation = arena->generation;
+}
+
+// shares children of already expanded node with equal game state instead of expanding node,
+// nodes on path from root are never linked to avoid cycles
+__host__ bool linkTransposition(nodeArena* arena, int idx, node* state, int* path, int depth)
+{
+    if (state->lastKill >= 0)
+        return false;
+    unsigned long long hash = hashPosition(state->fields, state->isQueen, state->blackTurn, state->lastKill);
+    transpositionEntry* entry = &arena->transpositions[hash & (TRANSPOSITION_TABLE_SIZE - 1)];
+    if (entry->generation != arena->generation || entry->hash != hash || entry->idx == idx)
+        return false;
+
+    int owner = entry->idx;
+    node ownerStorage;
+    node* ownerState = loadPosition(arena, nodePosition(arena, owner), &ownerStorage);
+    // pawn indices have to match too as moves of children refer to them
+    if (ownerState->blackTurn != state->blackTurn
+        || memcmp(ownerState->fields, state->fields, BOARD_SIZE * BOARD_SIZE * sizeof(int)) != 0
+        || memcmp(ownerState->isQueen, state->isQueen, PAWN_ROWS * BOARD_SIZE * sizeof(bool)) != 0)
+        return false;
+    for (int i = 0; i < depth; i++)
+        if (path[i] == owner)
+            return false;
+
+    nodeFirstChild(arena, idx) = nodeFirstChild(arena, owner);
+    nodeChildSize(arena, idx) = nodeChildSize(arena, owner).load();
+    nodeFlags(arena, idx) |= NODE_LINKED | NODE_EXPANDED;
+    return true;
+}
+
+// calculates average reward of node, nodes not yet visited are never preferred
+__host__ float getAverageReward(float rewardSum, int visits)
+{
+    if (visits == 0) return -FLT_MAX;
+    return rewardSum / visits;
+}
+
+// calculates value of move leading to node, proven wins are preferred over everything else and losses are last
+__host__ float getMoveValue(nodeArena* arena, int idx)
+{
+    unsigned short solved = nodeFlags(arena, idx) & NODE_SOLVED;
+    if (solved == NODE_WIN) return INFINITY;
+    if (solved == NODE_LOSS) return -INFINITY;
+    if (solved == NODE_DRAW) return 0;
+    return getAverageReward(nodeRewardSum(arena, idx), nodeVisits(arena, idx));
+}
+
+// marks node without moves as won by player who moved into it if opponent has no pawns left, otherwise as draw
+__host__ void markTerminal(nodeArena* arena, int idx, node* state)
+{
+    int start = state->blackTurn ? PAWN_ROWS * BOARD_SIZE / 2 : 0;
+    int end = state->blackTurn ? PAWN_ROWS * BOARD_SIZE : PAWN_ROWS * BOARD_SIZE / 2;
+    bool hasPawns = false;
+    for (int i = start; i < end && !hasPawns; i++)
+        hasPawns = state->rows[i] >= 0;
+    nodeFlags(arena, idx) |= hasPawns ? NODE_DRAW : NODE_WIN;
+}
+
+// proves result of node from results of its children, returns false if it isn't known yet
+__host__ bool solveNode(nodeArena* arena, int idx)
+{
+    if (nodeFlags(arena, idx) & NODE_SOLVED)
+        return true;
+    int childSize = nodeChildSize(arena, idx);
+    if (childSize == 0)
+        return false;
+    int firstChild = nodeFirstChild(arena, idx);
+    // results of children are from perspective of player to move in node
+    bool hasWin = false, hasDraw = false, allSolved = true;
+    for (int i = 0; i < childSize && !hasWin; i++)
+    {
+        unsigned short solved = nodeFlags(arena, firstChild + i) & NODE_SOLVED;
+        hasWin = solved == NODE_WIN;
+        hasDraw |= solved == NODE_DRAW;
+        allSolved &= solved != 0;
+    }
+    if (!hasWin && !allSolved)
+        return false;
+    unsigned short result = hasWin ? NODE_WIN : (hasDraw ? NODE_DRAW : NODE_LOSS);
+    // player moving in kill chain moves again, otherwise result is reversed for player who moved into node
+    bool sameMover = (nodeFlags(arena, firstChild) & NODE_BLACK_MOVED) == (nodeFlags(arena, idx) & NODE_BLACK_MOVED);
+    if (!sameMover && result != NODE_DRAW)
+        result = result == NODE_WIN ? NODE_LOSS : NODE_WIN;
+    nodeFlags(arena, idx) |= result;
+    return true;
+}
+
+// reward of solved node from perspective of player who moved into it
+__host__ float getSolvedReward(unsigned short solved)
+{
+    if (solved == NODE_WIN) return SOLVED_REWARD;
+    if (solved == NODE_LOSS) return -SOLVED_REWARD;
+    return 0;
+}
+
+// calculate upper confidence boundary value of node, exploration is 2 * sqrt(log(parentVisits)) of its parent
+__host__ float getUCBValue(float exploration, float childRewardSum, int childVisits)
+{
+    if (childVisits == 0) return INFINITY;
+    return childRewardSum / childVisits + exploration / sqrtf((float)childVisits);
+}
+
+#if UCB_SIMD
+// calculates upper confidence boundary values of four children,
+// 1 / sqrt(visits) is estimated by rsqrtps refined with one Newton-Raphson step
+__host__ __m128 getUCBValues(__m128 exploration, __m128 rewardSums, __m128 visits)
+{
+    __m128 invSqrt = _mm_rsqrt_ps(visits);
+    invSqrt = _mm_mul_ps(invSqrt, _mm_sub_ps(_mm_set1_ps(1.5f),
+        _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), visits), _mm_mul_ps(invSqrt, invSqrt))));
+    __m128 ucb = _mm_add_ps(_mm_div_ps(rewardSums, visits), _mm_mul_ps(exploration, invSqrt));
+    __m128 notVisited = _mm_cmpeq_ps(visits, _mm_setzero_ps());
+    return _mm_or_ps(_mm_and_ps(notVisited, _mm_set1_ps(INFINITY)), _mm_andnot_ps(notVisited, ucb));
+}
+#endif
+
+#if RAVE
+// blends average reward of node with all-moves-as-first one and adds exploration term of upper confidence boundary,
+// node without visits counts as visited once and gets all-moves-as-first reward only, or INFINITY without it either
+__host__ float getRAVEValue(float exploration, float childRewardSum, int childVisits, float amafRewardSum, float amafVisits)
+{
+    if (childVisits == 0 && amafVisits == 0) return INFINITY;
+    float beta = amafVisits == 0 ? 0 : childVisits == 0 ? 1 : sqrtf(RAVE_EQUIVALENCE / (3 * childVisits + RAVE_EQUIVALENCE));
+    float visits = childVisits == 0 ? 1.0f : (float)childVisits;
+    return (1 - beta) * childRewardSum / visits + (beta == 0 ? 0 : beta * amafRewardSum / amafVisits) + exploration / sqrtf(visits);
+}
+
+#if UCB_SIMD
+// calculates values of getRAVEValue for four children, 1 / sqrt(visits) is estimated as in getUCBValues
+__host__ __m128 getRAVEValues(__m128 exploration, __m128 rewardSums, __m128 visits, __m128 amafRewardSums, __m128 amafVisits)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 notVisited = _mm_cmpeq_ps(visits, _mm_setzero_ps());
+    __m128 noAmaf = _mm_cmpeq_ps(amafVisits, _mm_setzero_ps());
+    visits = _mm_max_ps(visits, one);
+    __m128 invSqrt = _mm_rsqrt_ps(visits);
+    invSqrt = _mm_mul_ps(invSqrt, _mm_sub_ps(_mm_set1_ps(1.5f),
+        _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), visits), _mm_mul_ps(invSqrt, invSqrt))));
+    __m128 equivalence = _mm_set1_ps(RAVE_EQUIVALENCE);
+    __m128 beta = _mm_sqrt_ps(_mm_div_ps(equivalence, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(3.0f), visits), equivalence)));
+    beta = _mm_andnot_ps(noAmaf, _mm_or_ps(_mm_and_ps(notVisited, one), _mm_andnot_ps(notVisited, beta)));
+    __m128 amafReward = _mm_andnot_ps(noAmaf, _mm_div_ps(amafRewardSums, _mm_max_ps(amafVisits, _mm_set1_ps(FLT_MIN))));
+    __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, beta), _mm_div_ps(rewardSums, visits)),
+        _mm_mul_ps(beta, amafReward)), _mm_mul_ps(exploration, invSqrt));
+    __m128 unknown = _mm_and_ps(notVisited, noAmaf);
+    return _mm_or_ps(_mm_and_ps(unknown, _mm_set1_ps(INFINITY)), _mm_andnot_ps(unknown, value));
+}
+#endif
+#endif
+
+#if PUCT
+// average reward of node from perspective of player to move in it, value of its children without visits
+__host__ float getFirstPlayValue(nodeArena* arena, int idx)
+{
+    int visits = nodeVisits(arena, idx);
+    if (visits == 0) return 0;
+    unsigned short flags = nodeFlags(arena, idx);
+    float value = nodeRewardSum(arena, idx) / visits;
+    return ((flags & NODE_BLACK_TURN) != 0) == ((flags & NODE_BLACK_MOVED) != 0) ? value : -value;
+}
+
+// calculates PUCT value of node, exploration is PUCT_CONSTANT * sqrt(parentVisits) of its parent
+__host__ float getPUCTValue(float exploration, float firstPlayValue, float childRewardSum, int childVisits, float prior)
+{
+    float value = childVisits == 0 ? firstPlayValue : childRewardSum / childVisits;
+    return value + exploration * prior / (1 + childVisits);
+}
+
+#if UCB_SIMD
+// calculates PUCT values of four children
+__host__ __m128 getPUCTValues(__m128 exploration, __m128 firstPlayValue, __m128 rewardSums, __m128 visits, __m128 priors)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 notVisited = _mm_cmpeq_ps(visits, _mm_setzero_ps());
+    __m128 value = _mm_or_ps(_mm_and_ps(notVisited, firstPlayValue),
+        _mm_andnot_ps(notVisited, _mm_div_ps(rewardSums, _mm_max_ps(visits, one))));
+    return _mm_add_ps(value, _mm_mul_ps(exploration, _mm_div_ps(priors, _mm_add_ps(one, visits))));
+}
+#endif
+#endif
+
+// number of first children of node with given visits that can be selected
+__host__ int getWideningLimit(int parentVisits, int childSize)
+{
+    if (!PROGRESSIVE_WIDENING)
+        return childSize;
+    int limit = (int)ceilf(PW_COEFFICIENT * powf((float)parentVisits, PW_EXPONENT));
+    return max(1, min(limit, childSize));
+}
+
+// selects child of node with biggest upper confidence boundary value (or PUCT value), first one of equal ones,
+// among children allowed by progressive widening
+__host__ int selectChild(nodeArena* arena, int idx)
+{
+    int parentVisits = nodeVisits(arena, idx);
+    int firstChild = nodeFirstChild(arena, idx);
+    int childSize = nodeChildSize(arena, idx);
+    int eligible = getWideningLimit(parentVisits, childSize);
+    nodeChunk* chunk = getChunk(arena, firstChild);
+    int offset = NODE_OFFSET(firstChild);
+#if PUCT
+    float exploration = PUCT_CONSTANT * sqrtf((float)parentVisits);
+    float firstPlayValue = getFirstPlayValue(arena, idx);
+#else
+    float exploration = 2 * sqrtf(logf((float)parentVisits));
+#endif
+    float maxUCB = -INFINITY;
+    int idxWithBiggestUCB = 0;
+#if UCB_SIMD
+    // children past the last eligible one and lost ones get reward of -INFINITY so they are never selected,
+    // lost ones let next child in instead
+    __m128 explorations = _mm_set1_ps(exploration);
+    alignas(16) float rewardSums[4];
+    alignas(16) float visits[4];
+    alignas(16) float ucbs[4];
+#if PUCT
+    __m128 firstPlayValues = _mm_set1_ps(firstPlayValue);
+    alignas(16) float priors[4];
+#elif RAVE
+    alignas(16) float amafRewardSums[4];
+    alignas(16) float amafVisits[4];
+#endif
+    for (int i = 0; i < eligible; i += 4)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            bool isLost = MCTS_SOLVER && i + j < eligible
+                && (chunk->flags[offset + i + j].load(std::memory_order_relaxed) & NODE_LOSS);
+            if (isLost && eligible < childSize)
+                eligible++;
+            bool isChild = i + j < eligible && !isLost;
+            rewardSums[j] = isChild ? chunk->rewardSum[offset + i + j].load(std::memory_order_relaxed) : -INFINITY;
+            visits[j] = isChild ? (float)chunk->visits[offset + i + j].load(std::memory_order_relaxed) : 1.0f;
+#if PUCT
+            priors[j] = isChild ? chunk->prior[offset + i + j] : 0.0f;
+#elif RAVE
+            amafRewardSums[j] = isChild ? chunk->amafRewardSum[offset + i + j].load(std::memory_order_relaxed) : 0.0f;
+            amafVisits[j] = isChild ? chunk->amafVisits[offset + i + j].load(std::memory_order_relaxed) : 0.0f;
+#endif
+        }
+#if PUCT
+        _mm_store_ps(ucbs, getPUCTValues(explorations, firstPlayValues, _mm_load_ps(rewardSums), _mm_load_ps(visits),
+            _mm_load_ps(priors)));
+#elif RAVE
+        _mm_store_ps(ucbs, getRAVEValues(explorations, _mm_load_ps(rewardSums), _mm_load_ps(visits),
+            _mm_load_ps(amafRewardSums), _mm_load_ps(amafVisits)));
+#else
+        _mm_store_ps(ucbs, getUCBValues(explorations, _mm_load_ps(rewardSums), _mm_load_ps(visits)));
+#endif
+        for (int j = 0; j < 4; j++)
+            if (ucbs[j] > maxUCB)
+            {
+                maxUCB = ucbs[j];
+                idxWithBiggestUCB = i + j;
+            }
+    }
+#else
+    float handlerUCB = 0;
+    for (int i = 0; i < eligible; i++)
+    {
+        if (MCTS_SOLVER && (chunk->flags[offset + i] & NODE_LOSS))
+        {
+            if (eligible < childSize)
+                eligible++;
+            continue;
+        }
+#if PUCT
+        if ((handlerUCB = getPUCTValue(exploration, firstPlayValue, chunk->rewardSum[offset + i], chunk->visits[offset + i],
+            chunk->prior[offset + i])) > maxUCB)
+#elif RAVE
+        if ((handlerUCB = getRAVEValue(exploration, chunk->rewardSum[offset + i], chunk->visits[offset + i],
+            chunk->amafRewardSum[offset + i], chunk->amafVisits[offset + i])) > maxUCB)
+#else
+        if ((handlerUCB = getUCBValue(exploration, chunk->rewardSum[offset + i], chunk->visits[offset + i])) > maxUCB)
+#endif
+        {
+            maxUCB = handlerUCB;
+            idxWithBiggestUCB = i;
+        }
+    }
+#endif
+    return firstChild + idxWithBiggestUCB;
+}
+
+#ifdef __CUDACC__
+// sum reduce
+template <unsigned int blockSize>
+__device__ void warpReduce(volatile float* sdata, unsigned int tid) {
+    if (blockSize >= 64) sdata[tid] += sdata[tid + 32];
+    if (blockSize >= 32) sdata[tid] += sdata[tid + 16];
+    if (blockSize >= 16) sdata[tid] += sdata[tid + 8];
+    if (blockSize >= 8) sdata[tid] += sdata[tid + 4];
+    if (blockSize >= 4) sdata[tid] += sdata[tid + 2];
+    if (blockSize >= 2) sdata[tid] += sdata[tid + 1];
+}
+#endif
+
+// performs copying node from dynamic memory node to static one
+void copyToFixedNode(node* root, fixedNode* fixed)
+{
+    for (int i = 0; i < PAWN_ROWS * BOARD_SIZE; i++)
+    {
+        fixed->cols[i] = root->cols[i];
+        fixed->rows[i] = root->rows[i];
+        fixed->isQueen[i] = root->isQueen[i];
+    }
+    for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+    {
+        fixed->fields[i] = root->fields[i];
+    }
+}
+
+// value that changes with every kill, promotion and non queen pawn move, as pawns can only move forward
+__host__ __device__ int getProgressKey(int* rows, bool* isQueen)
+{
+    int numOfPawns = 0;
+    int advancement = 0;
+    for (int i = 0; i < PAWN_ROWS * BOARD_SIZE; i++)
+    {
+        if (rows[i] < 0)
+            continue;
+        numOfPawns++;
+        if (!isQueen[i])
+            advancement += i < PAWN_ROWS * BOARD_SIZE / 2 ? rows[i] : BOARD_SIZE - 1 - rows[i];
+    }
+    return numOfPawns * PAWN_ROWS * BOARD_SIZE * BOARD_SIZE + advancement;
+}
+
+// starts tracking of rollout from position
+__host__ __device__ void initDrawTracker(drawTracker* tracker, int* rows, bool* isQueen)
+{
+    tracker->historySize = 0;
+    tracker->historyPos = 0;
+    tracker->progressKey = getProgressKey(rows, isQueen);
+    tracker->noProgressPlies = 0;
+}
+
+// updates tracker after ply, returns true when rollout should be adjudicated as draw
+__host__ __device__ bool isRolloutDraw(drawTracker* tracker, int* fields, int* rows, bool* isQueen, bool blackTurn)
+{
+    int progressKey = getProgressKey(rows, isQueen);
+
+    // positions before irreversible move can't appear again, hashing is skipped until position is reversible
+    if (progressKey != tracker->progressKey)
+    {
+        tracker->historySize = 0;
+        tracker->historyPos = 0;
+        tracker->progressKey = progressKey;
+        tracker->noProgressPlies = 0;
+        return false;
+    }
+    tracker->noProgressPlies++;
+    if (tracker->noProgressPlies >= NO_PROGRESS_LIMIT)
+        return true;
+
+    unsigned long long hash = hashPosition(fields, isQueen, blackTurn, -1);
+    for (int i = 0; i < tracker->historySize; i++)
+        if (tracker->history[i] == hash)
+            return true;
+
+    tracker->history[tracker->historyPos] = hash;
+    tracker->historyPos = (tracker->historyPos + 1) % REPETITION_HISTORY;
+    if (tracker->historySize < REPETITION_HISTORY)
+        tracker->historySize++;
+    return false;
+}
+
+// determines why rollout has ended
+__host__ __device__ int getRolloutEndReason(int* rows, int rolloutLength)
+{
+    int numOfWhite = 0, numOfBlack = 0;
+    for (int i = 0; i < PAWN_ROWS * BOARD_SIZE / 2; i++)
+        if (rows[i] >= 0) numOfWhite++;
+    for (int i = PAWN_ROWS * BOARD_SIZE / 2; i < PAWN_ROWS * BOARD_SIZE; i++)
+        if (rows[i] >= 0) numOfBlack++;
+
+    if (numOfWhite == 0 || numOfBlack == 0)
+        return ROLLOUT_END_WIN;
+    return rolloutLength < MAX_MOVES ? ROLLOUT_END_NO_MOVES : ROLLOUT_END_MAX_MOVES;
+}
+
+// adds finished rollout to statistics, on device they are shared by threads of block
+__host__ __device__ void recordRollout(rolloutStats* stats, int* rows, int basePawns, int rolloutLength, int endReason)
+{
+    unsigned long long captures = basePawns;
+    for (int i = 0; i < PAWN_ROWS * BOARD_SIZE; i++)
+        if (rows[i] >= 0) captures--;
+#ifdef __CUDA_ARCH__
+    atomicAdd(&stats->rollouts, 1ULL);
+    atomicAdd(&stats->plies, (unsigned long long)rolloutLength);
+    atomicAdd(&stats->captures, captures);
+    atomicAdd(&stats->endReasons[endReason], 1ULL);
+    atomicAdd(&stats->lengthHistogram[rolloutLength], 1ULL);
+#else
+    stats->rollouts++;
+    stats->plies += rolloutLength;
+    stats->captures += captures;
+    stats->endReasons[endReason]++;
+    stats->lengthHistogram[rolloutLength]++;
+#endif
+}
+
+// adds rollout statistics gathered by single thread to move statistics
+__host__ void mergeRolloutStats(rolloutStats* target, rolloutStats* source)
+{
+    target->rollouts += source->rollouts;
+    target->plies += source->plies;
+    target->captures += source->captures;
+    for (int i = 0; i < ROLLOUT_END_REASONS; i++)
+        target->endReasons[i] += source->endReasons[i];
+    for (int i = 0; i <= MAX_MOVES; i++)
+        target->lengthHistogram[i] += source->lengthHistogram[i];
+}
+
+// performs sequential random moves from position and evaluates it afterwards, position data structures are modified,
+// keys of moves played are set in playedMoves bitset if given
+template <typename Random>
+__host__ __device__ float runRollout(int* fields, int* rows, int* cols, bool* isQueen, bool blackTurn, int lastKill, bool blackEval, Random& random, rolloutStats* stats, unsigned int* playedMoves = nullptr)
+{
+    bool available[BOARD_SIZE * BOARD_SIZE];
+    bool pawnHasKill[PAWN_ROWS * BOARD_SIZE];
+    int numOfWhite = 0, numOfBlack = 0;
+
+    for (int i = 0; i < PAWN_ROWS * BOARD_SIZE / 2; i++)
+        if (rows[i] >= 0) numOfWhite++;
+    for (int i = PAWN_ROWS * BOARD_SIZE / 2; i < PAWN_ROWS * BOARD_SIZE; i++)
+        if (rows[i] >= 0) numOfBlack++;
+#if ROLLOUT_STATS
+    int basePawns = numOfWhite + numOfBlack;
+#else
+    // statistics are recorded only with ROLLOUT_STATS
+    (void)stats;
+#endif
+
+    // blackTurn of node in kill chain already belongs to player moving after the chain
+    bool isRunning = true;
+    if (lastKill >= 0)
+    {
+        isRunning = makeRandomAvailableMove(fields, rows, cols, pawnHasKill, isQueen,
+            blackTurn, available, numOfWhite, numOfBlack, random, lastKill, playedMoves);
+    }
+    int rolloutLength = 0;
+    bool isAdjudicatedDraw = false;
+#if ROLLOUT_DRAW_DETECTION
+    drawTracker tracker;
+    initDrawTracker(&tracker, rows, isQueen);
+#endif
+    for (; isRunning && rolloutLength < MAX_MOVES; rolloutLength++)
+    {
+        if (!makeRandomAvailableMove(fields, rows, cols, pawnHasKill, isQueen,
+            blackTurn, available, numOfWhite, numOfBlack, random, -1, playedMoves)) break;
+        blackTurn = !blackTurn;
+#if ROLLOUT_DRAW_DETECTION
+        if (isRolloutDraw(&tracker, fields, rows, isQueen, blackTurn))
+        {
+            isAdjudicatedDraw = true;
+            rolloutLength++;
+            break;
+        }
+#endif
+    }
+#if ROLLOUT_QUIESCENCE
+    // kills are mandatory, so exchange in progress is played out before position gets scored
+    if (!isAdjudicatedDraw && rolloutLength == MAX_MOVES)
+    {
+        for (int i = 0; i < QUIESCENCE_MAX_PLIES && hasAnyKill(fields, rows, cols, isQueen, blackTurn); i++)
+        {
+            if (!makeRandomAvailableMove(fields, rows, cols, pawnHasKill, isQueen,
+                blackTurn, available, numOfWhite, numOfBlack, random, -1, playedMoves)) break;
+            blackTurn = !blackTurn;
+        }
+    }
+#endif
+#if ROLLOUT_STATS
+    recordRollout(stats, rows, basePawns, rolloutLength,
+        isAdjudicatedDraw ? ROLLOUT_END_ADJUDICATION : getRolloutEndReason(rows, rolloutLength));
+#endif
+    // no available moves is scored as draw
+    if (isAdjudicatedDraw || (numOfWhite == 0 && numOfBlack == 0))
+        return 0;
+    return evaluatePositionValue(rows, cols, isQueen, blackEval);
+}
+
+// adds moves played by rollout to all-moves-as-first statistics of evaluation
+__host__ __device__ void recordAmaf(amafStats* amaf, unsigned int* playedMoves, float reward)
+{
+    // position of lowest set bit is found by de Bruijn multiplication
+    const int bitPositions[32] = { 0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+        31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9 };
+    for (int i = 0; i < AMAF_WORDS; i++)
+        for (unsigned int word = playedMoves[i]; word != 0; word &= word - 1)
+        {
+            int key = i * 32 + bitPositions[((word & (0u - word)) * 0x077CB531u) >> 27];
+#ifdef __CUDA_ARCH__
+            atomicAdd(&amaf->rewardSum[key], reward);
+            atomicAdd(&amaf->visits[key], 1u);
+#else
+            amaf->rewardSum[key] += reward;
+            amaf->visits[key]++;
+#endif
+        }
+}
+
+#ifdef __CUDACC__
+// performs sequential random moves and evaluates position afterwards,
+// moves played are added to all-moves-as-first statistics if given
+template <unsigned int blockSize>
+__global__ void d_runSimulation(fixedNode* root, float* rewards, float* squaredRewards, rolloutStats* g_rolloutStats, amafStats* g_amaf, bool blackTurn, int lastKill, bool blackEval, int numOfRollouts)
+{
+    extern __shared__ volatile float sumRewards[MAX_BLOCK];
+    __shared__ volatile float sumSquaredRewards[MAX_BLOCK];
+    unsigned int tid = threadIdx.x;
+#if ROLLOUT_STATS
+    // rollouts of block are counted in shared memory, global statistics get one addition per counter from each block
+    __shared__ rolloutStats blockStats;
+    unsigned long long* blockCounters = (unsigned long long*)&blockStats;
+    for (unsigned int i = tid; i < sizeof(rolloutStats) / sizeof(unsigned long long); i += blockDim.x)
+        blockCounters[i] = 0;
+    __syncthreads();
+    rolloutStats* stats = &blockStats;
+#else
+    rolloutStats* stats = g_rolloutStats;
+#endif
+    int fields[BOARD_SIZE * BOARD_SIZE];
+    int rows[PAWN_ROWS * BOARD_SIZE];
+    int cols[PAWN_ROWS * BOARD_SIZE];
+    bool isQueen[PAWN_ROWS * BOARD_SIZE];
 
+    curandState state;
 
-    int numOfWhite = g_numOfWhite, numOfBlack = g_numOfBlack;
+    curand_init(clock64(), tid, 0, &state);
+    deviceRandom random = { &state };
 
     for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
         fields[i] = root->fields[i];
@@ -1642,37 +3295,54 @@ __global__ void d_runSimulation(fixedNode* root, float* rewards, bool blackTurn,
         isQueen[i] = root->isQueen[i];
     }
 
-    bool available[PAWN_ROWS * BOARD_SIZE];
-    bool pawnHasKill[PAWN_ROWS * BOARD_SIZE];
+    // threads of last block past requested number of rollouts only take part in reduction
+    float reward = 0;
+    if (blockIdx.x * blockDim.x + tid < (unsigned int)numOfRollouts)
+    {
+#if RAVE
+        unsigned int playedMoves[AMAF_WORDS] = {};
+        reward = runRollout(fields, rows, cols, isQueen, blackTurn, lastKill, blackEval, random, stats,
+            g_amaf != nullptr ? playedMoves : nullptr);
+        if (g_amaf != nullptr)
+            recordAmaf(g_amaf, playedMoves, reward);
+#else
+        reward = runRollout(fields, rows, cols, isQueen, blackTurn, lastKill, blackEval, random, stats);
+#endif
+    }
+    sumRewards[tid] = reward;
+    sumSquaredRewards[tid] = reward * reward;
+    __syncthreads();
 
-    if (lastKill >= 0)
+    if (blockSize >= 1024) { if (tid < 512) { sumRewards[tid] += sumRewards[tid + 512]; sumSquaredRewards[tid] += sumSquaredRewards[tid + 512]; } __syncthreads(); }
+    if (blockSize >= 512) { if (tid < 256) { sumRewards[tid] += sumRewards[tid + 256]; sumSquaredRewards[tid] += sumSquaredRewards[tid + 256]; } __syncthreads(); }
+    if (blockSize >= 256) { if (tid < 128) { sumRewards[tid] += sumRewards[tid + 128]; sumSquaredRewards[tid] += sumSquaredRewards[tid + 128]; } __syncthreads(); }
+    if (blockSize >= 128) { if (tid < 64) { sumRewards[tid] += sumRewards[tid + 64]; sumSquaredRewards[tid] += sumSquaredRewards[tid + 64]; } __syncthreads(); }
+    if (tid < 32)
     {
-        d_makeRandomAvailableMove(fields, rows, cols, pawnHasKill, isQueen,
-            blackTurn, available, numOfWhite, numOfBlack, &state, lastKill);
+        warpReduce<blockSize>(sumRewards, tid);
+        warpReduce<blockSize>(sumSquaredRewards, tid);
     }
-    for (int i = 0; i < MAX_MOVES; i++)
+    if (tid == 0)
     {
-        if (!d_makeRandomAvailableMove(fields, rows, cols, pawnHasKill, isQueen,
-            blackTurn, available, numOfWhite, numOfBlack, &state)) break;
-        blackTurn = !blackTurn;
+        rewards[blockIdx.x] = sumRewards[0];
+        squaredRewards[blockIdx.x] = sumSquaredRewards[0];
+#if ROLLOUT_STATS
+        unsigned long long* globalCounters = (unsigned long long*)g_rolloutStats;
+        for (unsigned int i = 0; i < sizeof(rolloutStats) / sizeof(unsigned long long); i++)
+            if (blockCounters[i] != 0)
+                atomicAdd(&globalCounters[i], blockCounters[i]);
+#endif
     }
-    sumRewards[tid] = evaluatePositionValue(rows, cols, isQueen, blackEval);
-    __syncthreads();
-
-    if (blockSize >= 512) { if (tid < 256) { sumRewards[tid] += sumRewards[tid + 256]; } __syncthreads(); }
-    if (blockSize >= 256) { if (tid < 128) { sumRewards[tid] += sumRewards[tid + 128]; } __syncthreads(); }
-    if (blockSize >= 128) { if (tid < 64) { sumRewards[tid] += sumRewards[tid + 64]; } __syncthreads(); }
-    if (tid < 32) warpReduce<blockSize>(sumRewards, tid);
-    if (tid == 0) rewards[blockIdx.x] = sumRewards[0];
 
 }
 
 // inits memory for gpu purposes
-bool d_initMemory(float** d_rewards, fixedNode** d_fixed, int blockNum)
+bool d_initMemory(float** d_rewards, fixedNode** d_fixed, rolloutStats** d_rolloutStats, amafStats** d_amaf, int blockNum)
 {
     cudaError_t cudaStatus;
 
-    cudaStatus = cudaMalloc((void**)d_rewards, blockNum * sizeof(float));
+    // first half holds rewards sums of blocks, second one sums of squared rewards
+    cudaStatus = cudaMalloc((void**)d_rewards, 2 * blockNum * sizeof(float));
     if (cudaStatus != cudaSuccess) {
         fprintf(stderr, "cudaMalloc failed!");
         return false;
@@ -1683,237 +3353,820 @@ bool d_initMemory(float** d_rewards, fixedNode** d_fixed, int blockNum)
         cudaFree(d_rewards);
         return false;
     }
+#if ROLLOUT_STATS
+    cudaStatus = cudaMalloc((void**)d_rolloutStats, sizeof(rolloutStats));
+    if (cudaStatus != cudaSuccess) {
+        fprintf(stderr, "cudaMalloc failed!");
+        cudaFree(*d_rewards);
+        cudaFree(*d_fixed);
+        return false;
+    }
+#endif
+#if RAVE
+    cudaStatus = cudaMalloc((void**)d_amaf, sizeof(amafStats));
+    if (cudaStatus != cudaSuccess) {
+        fprintf(stderr, "cudaMalloc failed!");
+        cudaFree(*d_rewards);
+        cudaFree(*d_fixed);
+        if (*d_rolloutStats != nullptr)
+            cudaFree(*d_rolloutStats);
+        return false;
+    }
+#endif
 
     return true;
 }
 
 // frees memory for gpu purposes
-void d_freeMemory(float* d_rewards, fixedNode* d_fixed)
+void d_freeMemory(float* d_rewards, fixedNode* d_fixed, rolloutStats* d_rolloutStats, amafStats* d_amaf)
 {
     cudaFree(d_rewards);
     cudaFree(d_fixed);
+    if (d_rolloutStats != nullptr)
+        cudaFree(d_rolloutStats);
+    if (d_amaf != nullptr)
+        cudaFree(d_amaf);
+}
+#endif
+
+// inits cache of evaluations
+__host__ evalCache* initEvalCache()
+{
+    evalCache* cache = new evalCache;
+    cache->entries = new evalCacheEntry[EVAL_CACHE_SIZE];
+    cache->locks = new std::mutex[EVAL_CACHE_LOCKS];
+    for (int i = 0; i < EVAL_CACHE_SIZE; i++)
+        cache->entries[i].numOfEvaluations = 0;
+    return cache;
 }
 
-// evaluates position value by running multiple simulations
-bool deviceMakeEvaluation(node* root, bool blackEval, int player, float* d_rewards, fixedNode* d_fixed, std::chrono::nanoseconds* timeStamps)
+// frees memory allocated to cache of evaluations
+__host__ void freeEvalCache(evalCache* cache)
 {
-    int numOfEvaluations = (player == PLAYER_ONE ? NUM_OF_EVAL_ONE : NUM_OF_EVAL_TWO);
+    delete[] cache->entries;
+    delete[] cache->locks;
+    delete cache;
+}
 
-    unsigned int blockSize = min(numOfEvaluations, 1024);
-    unsigned int blockNum = (int)ceil(numOfEvaluations / (float)blockSize);
+// gets slot of cache for position evaluated by player
+__host__ int getCacheSlot(unsigned long long hash, int player)
+{
+    return (int)((hash + (unsigned long long)player * (EVAL_CACHE_SIZE / 2 + 1)) & (EVAL_CACHE_SIZE - 1));
+}
 
-    cudaError_t cudaStatus;
+// looks up simulations result of position run by player, rewards are converted to evaluating player perspective
+__host__ bool lookupEvaluation(evalCache* cache, unsigned long long hash, int player, bool blackEval, double& sumRewards, double& sumSquaredRewards, int& numOfEvaluations)
+{
+    if (!EVAL_CACHE || cache == nullptr)
+        return false;
+    int slot = getCacheSlot(hash, player);
+    std::lock_guard<std::mutex> lock(cache->locks[slot % EVAL_CACHE_LOCKS]);
+    evalCacheEntry* entry = &cache->entries[slot];
+    if (entry->numOfEvaluations == 0 || entry->hash != hash || entry->player != player)
+        return false;
+    sumRewards = entry->sumRewards * (blackEval ? 1 : -1);
+    sumSquaredRewards = entry->sumSquaredRewards;
+    numOfEvaluations = entry->numOfEvaluations;
+    return true;
+}
 
-    fixedNode* h_fixed = (fixedNode*)malloc(sizeof(fixedNode));
-    copyToFixedNode(root, h_fixed);
+// stores simulations result of position run by player, newer results replace colliding ones
+__host__ void storeEvaluation(evalCache* cache, unsigned long long hash, int player, bool blackEval, double sumRewards, double sumSquaredRewards, int numOfEvaluations)
+{
+    if (!EVAL_CACHE || cache == nullptr || numOfEvaluations == 0)
+        return;
+    int slot = getCacheSlot(hash, player);
+    std::lock_guard<std::mutex> lock(cache->locks[slot % EVAL_CACHE_LOCKS]);
+    evalCacheEntry* entry = &cache->entries[slot];
+    entry->hash = hash;
+    entry->player = player;
+    entry->sumRewards = sumRewards * (blackEval ? 1 : -1);
+    entry->sumSquaredRewards = sumSquaredRewards;
+    entry->numOfEvaluations = numOfEvaluations;
+}
 
-    auto gpuMemAllocStart1 = std::chrono::high_resolution_clock::now();
-    cudaStatus = cudaMemcpy(d_fixed, h_fixed, sizeof(fixedNode), cudaMemcpyHostToDevice);
-    if (cudaStatus != cudaSuccess) {
-        fprintf(stderr, "cudaMemcpy failed!");
+// finds best average reward among already evaluated siblings of node
+__host__ bool getSiblingBest(nodeArena* arena, int leafIdx, float& siblingBest)
+{
+    bool hasSibling = false;
+    int parentIdx = nodeParent(arena, leafIdx);
+    if (parentIdx < 0)
         return false;
+    int firstChild = nodeFirstChild(arena, parentIdx);
+    nodeChunk* chunk = getChunk(arena, firstChild);
+    int offset = NODE_OFFSET(firstChild);
+    for (int i = 0; i < nodeChildSize(arena, parentIdx); i++)
+    {
+        if (firstChild + i == leafIdx || chunk->visits[offset + i] == 0)
+            continue;
+        float avgReward = chunk->rewardSum[offset + i] / chunk->visits[offset + i];
+        if (!hasSibling || avgReward > siblingBest)
+            siblingBest = avgReward;
+        hasSibling = true;
     }
-    auto gpuMemAllocEnd1 = std::chrono::high_resolution_clock::now();
-    int baseNumOfWhite = 0;
-    int baseNumOfBlack = 0;
+    return hasSibling;
+}
 
-    for (int i = 0; i < PAWN_ROWS * BOARD_SIZE / 2; i++)
-        if (root->rows[i] >= 0) baseNumOfWhite++;
-    for (int i = PAWN_ROWS * BOARD_SIZE / 2; i < PAWN_ROWS * BOARD_SIZE; i++)
-        if (root->rows[i] >= 0) baseNumOfBlack++;
+// number of simulations of next batch of leaf evaluation, limited by evaluations left for leaf
+// and simulations left in budget with ones already run for leaf, 0 once budget runs out unless leaf has no reward yet
+__host__ int getBatchSize(int batchSize, int maxEvaluations, int numOfEvaluations, int cachedEvaluations, searchBudget* budget)
+{
+    long long size = min(batchSize, maxEvaluations - numOfEvaluations);
+    if (budget->maxSimulations > 0)
+        size = min(size, budget->maxSimulations - budget->simulations.load(std::memory_order_relaxed)
+            - (numOfEvaluations - cachedEvaluations));
+    return (int)max(size, numOfEvaluations == 0 ? 1LL : 0LL);
+}
+
+// determines if reward mean is known precisely enough to stop running next batches of simulations
+__host__ bool shouldStopEvaluation(double sumRewards, double sumSquaredRewards, int numOfEvaluations, bool hasSibling, float siblingBest)
+{
+    if (!ADAPTIVE_EVAL || numOfEvaluations < 2)
+        return false;
+    double mean = sumRewards / numOfEvaluations;
+    double variance = (sumSquaredRewards - sumRewards * mean) / (numOfEvaluations - 1);
+    if (variance < 0)
+        variance = 0;
+    double halfWidth = EVAL_CONFIDENCE_Z * sqrt(variance / numOfEvaluations);
+    if (halfWidth <= EVAL_CI_HALF_WIDTH)
+        return true;
+    return hasSibling && fabs(mean - siblingBest) > halfWidth;
+}
+
+#ifdef __CUDACC__
+// evaluates position value by running multiple simulations, moves they play are gathered in amaf if given
+bool deviceMakeEvaluation(nodeArena* arena, int rootIdx, node* root, bool blackEval, int player, float* d_rewards, fixedNode* d_fixed, rolloutStats* d_rolloutStats, amafStats* d_amaf, evalCache* cache, searchBudget* budget, std::chrono::nanoseconds* timeStamps, searchStats* stats, float& reward, amafStats* amaf)
+{
+    int maxEvaluations = (player == PLAYER_ONE ? NUM_OF_EVAL_ONE : NUM_OF_EVAL_TWO);
+    int batchSize = ADAPTIVE_EVAL ? (player == PLAYER_ONE ? EVAL_BATCH_ONE : EVAL_BATCH_TWO) : maxEvaluations;
+
+    unsigned int blockSize = min(maxEvaluations, 1024);
+    unsigned int blockNum = (int)ceil(maxEvaluations / (float)blockSize);
 
-    auto deviceStart1 = std::chrono::high_resolution_clock::now();
+    cudaError_t cudaStatus;
+
+    fixedNode h_fixed;
+    copyToFixedNode(root, &h_fixed);
 
-    if (player == PLAYER_ONE)
+    auto gpuMemAllocStart = std::chrono::high_resolution_clock::now();
+    cudaStatus = cudaMemcpy(d_fixed, &h_fixed, sizeof(fixedNode), cudaMemcpyHostToDevice);
+    if (cudaStatus != cudaSuccess) {
+        fprintf(stderr, "cudaMemcpy failed!");
+        return false;
+    }
+#if ROLLOUT_STATS
+    cudaStatus = cudaMemset(d_rolloutStats, 0, sizeof(rolloutStats));
+    if (cudaStatus != cudaSuccess) {
+        fprintf(stderr, "cudaMemset failed!");
+        return false;
+    }
+#endif
+    if (amaf != nullptr)
     {
-        d_runSimulation<BLOCK_SIZE_ONE> << < BLOCK_NUM_ONE_V, BLOCK_SIZE_ONE_V, MAX_BLOCK * sizeof(float) >> > (d_fixed, d_rewards, root->blackTurn, root->lastKill, blackEval, baseNumOfWhite, baseNumOfBlack);
+        cudaStatus = cudaMemset(d_amaf, 0, sizeof(amafStats));
+        if (cudaStatus != cudaSuccess) {
+            fprintf(stderr, "cudaMemset failed!");
+            return false;
+        }
     }
-    else
+    auto gpuMemAllocEnd = std::chrono::high_resolution_clock::now();
+    timeStamps[1] += gpuMemAllocEnd - gpuMemAllocStart;
+
+    float siblingBest = 0;
+    bool hasSibling = getSiblingBest(arena, rootIdx, siblingBest);
+    double sumRewards = 0;
+    double sumSquaredRewards = 0;
+    int numOfEvaluations = 0;
+    unsigned long long hash = hashPosition(root->fields, root->isQueen, root->blackTurn, root->lastKill);
+    if (lookupEvaluation(cache, hash, player, blackEval, sumRewards, sumSquaredRewards, numOfEvaluations))
     {
-        d_runSimulation<BLOCK_SIZE_TWO> << <BLOCK_NUM_TWO_V, BLOCK_SIZE_TWO_V, MAX_BLOCK * sizeof(float) >> > (d_fixed, d_rewards, root->blackTurn, root->lastKill, blackEval, baseNumOfWhite, baseNumOfBlack);
+        stats->cacheHits++;
+        stats->simulationsReused += numOfEvaluations;
     }
+    int cachedEvaluations = numOfEvaluations;
+    thrust::device_ptr<float> dev_ptr = thrust::device_pointer_cast(d_rewards);
 
-    cudaStatus = cudaDeviceSynchronize();
-    auto deviceEnd1 = std::chrono::high_resolution_clock::now();
-
-    if (cudaStatus != cudaSuccess)
+    // once budget runs out leaf keeps reward of simulations run so far
+    while (numOfEvaluations < maxEvaluations
+        && !shouldStopEvaluation(sumRewards, sumSquaredRewards, numOfEvaluations, hasSibling, siblingBest)
+        && (numOfEvaluations == 0 || !budgetExhausted(budget)))
     {
-        fprintf(stderr, "cudaDeviceSynchronize failed");
-        return false;
+        int batch = getBatchSize(batchSize, maxEvaluations, numOfEvaluations, cachedEvaluations, budget);
+        if (batch == 0)
+            break;
+        unsigned int batchBlockNum = (int)ceil(batch / (float)blockSize);
+        auto deviceStart = std::chrono::high_resolution_clock::now();
+
+        if (player == PLAYER_ONE)
+        {
+            d_runSimulation<BLOCK_SIZE_ONE> << < dim3(batchBlockNum, 1, 1), BLOCK_SIZE_ONE_V, MAX_BLOCK * sizeof(float) >> > (d_fixed, d_rewards, d_rewards + blockNum, d_rolloutStats, amaf != nullptr ? d_amaf : nullptr, root->blackTurn, root->lastKill, blackEval, batch);
+        }
+        else
+        {
+            d_runSimulation<BLOCK_SIZE_TWO> << < dim3(batchBlockNum, 1, 1), BLOCK_SIZE_TWO_V, MAX_BLOCK * sizeof(float) >> > (d_fixed, d_rewards, d_rewards + blockNum, d_rolloutStats, amaf != nullptr ? d_amaf : nullptr, root->blackTurn, root->lastKill, blackEval, batch);
+        }
+
+        cudaStatus = cudaDeviceSynchronize();
+
+        if (cudaStatus != cudaSuccess)
+        {
+            fprintf(stderr, "cudaDeviceSynchronize failed");
+            return false;
+        }
+
+        sumRewards += thrust::reduce(dev_ptr, dev_ptr + batchBlockNum, 0.0f);
+        sumSquaredRewards += thrust::reduce(dev_ptr + blockNum, dev_ptr + blockNum + batchBlockNum, 0.0f);
+        numOfEvaluations += batch;
+
+        auto deviceEnd = std::chrono::high_resolution_clock::now();
+        timeStamps[0] += deviceEnd - deviceStart;
     }
 
-    float* rewards = (float*)malloc(blockNum * sizeof(float));
+    reward = (float)(sumRewards / numOfEvaluations);
+    storeEvaluation(cache, hash, player, blackEval, sumRewards, sumSquaredRewards, numOfEvaluations);
+
+    stats->simulations += numOfEvaluations - cachedEvaluations;
+    budget->simulations += numOfEvaluations - cachedEvaluations;
+    if (numOfEvaluations - cachedEvaluations < maxEvaluations)
+        stats->simulationsSaved += maxEvaluations - (numOfEvaluations - cachedEvaluations);
+
+#if ROLLOUT_STATS
+    rolloutStats h_rolloutStats;
     auto gpuMemAllocStart2 = std::chrono::high_resolution_clock::now();
-    cudaStatus = cudaMemcpy(rewards, d_rewards, blockNum * sizeof(float), cudaMemcpyDeviceToHost);
+    cudaStatus = cudaMemcpy(&h_rolloutStats, d_rolloutStats, sizeof(rolloutStats), cudaMemcpyDeviceToHost);
     if (cudaStatus != cudaSuccess) {
         fprintf(stderr, "cudaMemcpy failed!");
         return false;
     }
-    thrust::device_ptr<float> dev_ptr = thrust::device_pointer_cast(d_rewards);
     auto gpuMemAllocEnd2 = std::chrono::high_resolution_clock::now();
-    
-    auto deviceStart2 = std::chrono::high_resolution_clock::now();
-    float sumRewards = (float)thrust::reduce(dev_ptr, dev_ptr + blockNum, 0);
-    auto deviceEnd2 = std::chrono::high_resolution_clock::now();
-    
-    root->avgReward = sumRewards / numOfEvaluations;
-
-    timeStamps[0] += (deviceEnd1 - deviceStart1) + (deviceEnd2 - deviceStart2);
-    timeStamps[1] += (gpuMemAllocEnd1 - gpuMemAllocStart1) + (gpuMemAllocEnd2 - gpuMemAllocStart2);
+    timeStamps[1] += gpuMemAllocEnd2 - gpuMemAllocStart2;
+    mergeRolloutStats(&stats->rollouts, &h_rolloutStats);
+#endif
+    if (amaf != nullptr)
+    {
+        auto gpuMemAllocStart3 = std::chrono::high_resolution_clock::now();
+        cudaStatus = cudaMemcpy(amaf, d_amaf, sizeof(amafStats), cudaMemcpyDeviceToHost);
+        if (cudaStatus != cudaSuccess) {
+            fprintf(stderr, "cudaMemcpy failed!");
+            return false;
+        }
+        amaf->numOfRollouts = numOfEvaluations - cachedEvaluations;
+        auto gpuMemAllocEnd3 = std::chrono::high_resolution_clock::now();
+        timeStamps[1] += gpuMemAllocEnd3 - gpuMemAllocStart3;
+    }
 
     return true;
 }
+#endif
 
-// evaluates position value by running multiple simulations
-void hostMakeEvaluation(node* root, bool blackEval, int player, std::chrono::nanoseconds* timeStamps)
+// evaluates position value by running multiple simulations, moves they play are gathered in amaf if given
+void hostMakeEvaluation(nodeArena* arena, int rootIdx, node* root, bool blackEval, int player, hostRandom& random, evalCache* cache, searchBudget* budget, std::chrono::nanoseconds* timeStamps, searchStats* stats, float& reward, amafStats* amaf)
 {
     auto cpuStart = std::chrono::high_resolution_clock::now();
-    float sumRewards = 0;
-    int baseNumOfWhite = 0;
-    int baseNumOfBlack = 0;
+    int maxEvaluations = (player == PLAYER_ONE ? NUM_OF_EVAL_ONE : NUM_OF_EVAL_TWO);
+    int batchSize = ADAPTIVE_EVAL ? (player == PLAYER_ONE ? EVAL_BATCH_ONE : EVAL_BATCH_TWO) : maxEvaluations;
+    double sumRewards = 0;
+    double sumSquaredRewards = 0;
+    int numOfEvaluations = 0;
+    float siblingBest = 0;
+    bool hasSibling = getSiblingBest(arena, rootIdx, siblingBest);
+    unsigned long long hash = hashPosition(root->fields, root->isQueen, root->blackTurn, root->lastKill);
+    if (lookupEvaluation(cache, hash, player, blackEval, sumRewards, sumSquaredRewards, numOfEvaluations))
+    {
+        stats->cacheHits++;
+        stats->simulationsReused += numOfEvaluations;
+    }
+    int cachedEvaluations = numOfEvaluations;
+    rolloutStats threadRolloutStats = {};
+    unsigned int playedMoves[AMAF_WORDS];
+    if (amaf != nullptr)
+    {
+        memset(amaf->rewardSum, 0, sizeof(amaf->rewardSum));
+        memset(amaf->visits, 0, sizeof(amaf->visits));
+    }
 
-    int numOfWhite = 0, numOfBlack = 0;
+    // once budget runs out leaf keeps reward of simulations run so far
+    while (numOfEvaluations < maxEvaluations
+        && !shouldStopEvaluation(sumRewards, sumSquaredRewards, numOfEvaluations, hasSibling, siblingBest)
+        && (numOfEvaluations == 0 || !budgetExhausted(budget)))
+    {
+        int batch = getBatchSize(batchSize, maxEvaluations, numOfEvaluations, cachedEvaluations, budget);
+        if (batch == 0)
+            break;
+        int batchEnd = numOfEvaluations + batch;
+        for (; numOfEvaluations < batchEnd; numOfEvaluations++)
+        {
+            fixedNode position;
+            copyToFixedNode(root, &position);
+            if (amaf != nullptr)
+                memset(playedMoves, 0, sizeof(playedMoves));
+            float rolloutReward = runRollout(position.fields, position.rows, position.cols, position.isQueen,
+                root->blackTurn, root->lastKill, blackEval, random, &threadRolloutStats, amaf != nullptr ? playedMoves : nullptr);
+            if (amaf != nullptr)
+                recordAmaf(amaf, playedMoves, rolloutReward);
+            sumRewards += rolloutReward;
+            sumSquaredRewards += rolloutReward * rolloutReward;
+        }
+    }
+    reward = (float)(sumRewards / numOfEvaluations);
+    storeEvaluation(cache, hash, player, blackEval, sumRewards, sumSquaredRewards, numOfEvaluations);
+    if (amaf != nullptr)
+        amaf->numOfRollouts = numOfEvaluations - cachedEvaluations;
+
+    stats->simulations += numOfEvaluations - cachedEvaluations;
+    budget->simulations += numOfEvaluations - cachedEvaluations;
+    if (numOfEvaluations - cachedEvaluations < maxEvaluations)
+        stats->simulationsSaved += maxEvaluations - (numOfEvaluations - cachedEvaluations);
+#if ROLLOUT_STATS
+    mergeRolloutStats(&stats->rollouts, &threadRolloutStats);
+#endif
 
-    for (int i = 0; i < PAWN_ROWS * BOARD_SIZE / 2; i++)
-        if (root->rows[i] >= 0) baseNumOfWhite++;
-    for (int i = PAWN_ROWS * BOARD_SIZE / 2; i < PAWN_ROWS * BOARD_SIZE; i++)
-        if (root->rows[i] >= 0) baseNumOfBlack++;
+    auto cpuEnd = std::chrono::high_resolution_clock::now();
+    timeStamps[2] += cpuEnd - cpuStart;
+}
 
-    for (int p = 0; p < (player == PLAYER_ONE ? NUM_OF_EVAL_ONE : NUM_OF_EVAL_TWO); p++)
+// adds visits and rewards of root children of worker tree to main tree, children of both are in same order
+__host__ void mergeRootStats(nodeArena* arena, int rootIdx, nodeArena* worker, int workerRootIdx)
+{
+    if (workerRootIdx < 0 || nodeChildSize(worker, workerRootIdx) != nodeChildSize(arena, rootIdx))
+        return;
+    nodeVisits(arena, rootIdx) += nodeVisits(worker, workerRootIdx);
+    for (int i = 0; i < nodeChildSize(arena, rootIdx); i++)
     {
-        node* copyNode = initNode(root->fields, root->rows, root->cols, root->isQueen, root->blackTurn);
-        copyNode->lastKill = root->lastKill;
-        bool* pawnHasKill = new bool[PAWN_ROWS * BOARD_SIZE];
-        bool* available = new bool[BOARD_SIZE * BOARD_SIZE];
-        bool blackTurn = copyNode->blackTurn;
+        int childIdx = nodeFirstChild(arena, rootIdx) + i;
+        int workerChildIdx = nodeFirstChild(worker, workerRootIdx) + i;
+        nodeVisits(arena, childIdx) += nodeVisits(worker, workerChildIdx);
+        addReward(nodeRewardSum(arena, childIdx), nodeRewardSum(worker, workerChildIdx));
+#if RAVE
+        addReward(nodeAmafVisits(arena, childIdx), nodeAmafVisits(worker, workerChildIdx));
+        addReward(nodeAmafRewardSum(arena, childIdx), nodeAmafRewardSum(worker, workerChildIdx));
+#endif
+    }
+}
 
-        numOfWhite = baseNumOfWhite;
-        numOfBlack = baseNumOfBlack;
+// adds search statistics of worker to main ones
+__host__ void mergeSearchStats(searchStats* target, searchStats* source)
+{
+    target->simulations += source->simulations;
+    target->simulationsSaved += source->simulationsSaved;
+    target->cacheHits += source->cacheHits;
+    target->simulationsReused += source->simulationsReused;
+    target->transpositionsLinked += source->transpositionsLinked;
+    target->iterations += source->iterations;
+    target->nodesRecycled += source->nodesRecycled;
+    target->nodesSolved += source->nodesSolved;
+    mergeRolloutStats(&target->rollouts, &source->rollouts);
+}
 
-        if (copyNode->lastKill >= 0)
+#if RAVE
+// adds result of simulation to all-moves-as-first statistics of children of nodes on path, child whose move
+// is played later on path by same player counts as visited once with reward of leaf, otherwise its move
+// counts by share of simulations of leaf that played it, with their average reward
+__host__ void updateAmaf(nodeArena* arena, int* path, int depth, bool blackEval, float reward, amafStats* amaf)
+{
+    unsigned int treeMoves[AMAF_WORDS] = {};
+    for (int i = depth - 2; i >= 0; i--)
+    {
+        edgeMove played = getChunk(arena, path[i + 1])->move[NODE_OFFSET(path[i + 1])];
+        int playedKey = getAmafKey(played.pawn, played.row * BOARD_SIZE + played.col);
+        treeMoves[playedKey / 32] |= 1u << (playedKey % 32);
+        int firstChild = nodeFirstChild(arena, path[i]);
+        int childSize = nodeChildSize(arena, path[i]);
+        nodeChunk* chunk = getChunk(arena, firstChild);
+        int offset = NODE_OFFSET(firstChild);
+        for (int j = 0; j < childSize; j++)
         {
-            h_makeRandomAvailableMove(copyNode->fields, copyNode->rows, copyNode->cols, pawnHasKill, copyNode->isQueen,
-                blackTurn, available, numOfWhite, numOfBlack, copyNode->lastKill);
+            edgeMove move = chunk->move[offset + j];
+            int key = getAmafKey(move.pawn, move.row * BOARD_SIZE + move.col);
+            float sign = ((chunk->flags[offset + j] & NODE_BLACK_MOVED) != 0) == blackEval ? 1.0f : -1.0f;
+            if (treeMoves[key / 32] & (1u << (key % 32)))
+            {
+                addReward(chunk->amafVisits[offset + j], 1.0f);
+                addReward(chunk->amafRewardSum[offset + j], sign * reward);
+            }
+            else if (amaf->numOfRollouts > 0 && amaf->visits[key] > 0)
+            {
+                addReward(chunk->amafVisits[offset + j], amaf->visits[key] / (float)amaf->numOfRollouts);
+                addReward(chunk->amafRewardSum[offset + j], sign * amaf->rewardSum[key] / amaf->numOfRollouts);
+            }
         }
-        for (int i = 0; i < MAX_MOVES; i++)
+    }
+}
+#endif
+
+// grows MCTS tree from root with already expanded children until budget shared by threads runs out,
+// threads growing same tree add virtual loss to nodes on their path to spread over different lines
+void runSearch(nodeArena* arena, int rootIdx, int player, searchBudget* budget, bool virtualLoss, hostRandom& random, float* d_rewards, fixedNode* d_fixed, rolloutStats* d_rolloutStats, amafStats* d_amaf, evalCache* cache, std::chrono::nanoseconds* timeStamps, searchStats* stats)
+{
+    node rootState;
+    node* root = loadPosition(arena, nodePosition(arena, rootIdx), &rootState);
+    bool transpositions = TRANSPOSITIONS && !virtualLoss;
+    // shared children of transpositions and paths of other threads would be lost with recycled nodes
+    bool recycling = TREE_RECYCLE && !TRANSPOSITIONS && !virtualLoss;
+    int lossVisits = virtualLoss ? VIRTUAL_LOSS : 0;
+    // game states of nodes without state kept in arena are built here during descent
+    node scratch;
+    amafStats* amaf = nullptr;
+#if RAVE
+    amafStats leafAmaf;
+    amaf = &leafAmaf;
+#endif
+    while (!(MCTS_SOLVER && (nodeFlags(arena, rootIdx) & NODE_SOLVED)) && takeIteration(budget, arena))
+    {
+        stats->iterations++;
+        int selectedIdx = rootIdx;
+        node* selectedState = root;
+        // states kept in arena are unpacked only for nodes which need them
+        int pendingPosition = -1;
+        int path[MAX_TREE_DEPTH];
+        int depth = 0;
+        path[depth++] = rootIdx;
+        if (virtualLoss)
+            addVirtualLoss(arena, rootIdx);
+        while (depth < MAX_TREE_DEPTH)
         {
-            if (!h_makeRandomAvailableMove(copyNode->fields, copyNode->rows, copyNode->cols, pawnHasKill, copyNode->isQueen,
-                blackTurn, available, numOfWhite, numOfBlack)) break;
-            blackTurn = !blackTurn;
+            if (MCTS_SOLVER && (nodeFlags(arena, selectedIdx) & NODE_SOLVED))
+                break;
+            // evaluated leaf is expanded and one of its children is evaluated instead,
+            // leaf being expanded by other thread is evaluated again
+            if (nodeChildSize(arena, selectedIdx) == 0)
+            {
+                if (nodeVisits(arena, selectedIdx) == lossVisits
+                    || (nodeFlags(arena, selectedIdx) & NODE_EXPANDED)
+                    || !claimExpansion(arena, selectedIdx))
+                    break;
+                selectedState = resolvePosition(arena, &pendingPosition, selectedState, &scratch);
+                if (transpositions && linkTransposition(arena, selectedIdx, selectedState, path, depth))
+                {
+                    stats->transpositionsLinked++;
+                }
+                else
+                {
+                    if (!expandNode(arena, selectedIdx, selectedState) && recycling)
+                    {
+                        int released = recycleNodes(arena, rootIdx, path, depth);
+                        stats->nodesRecycled += released;
+                        if (released > 0)
+                            expandNode(arena, selectedIdx, selectedState);
+                    }
+                    if (transpositions)
+                        storeTransposition(arena, selectedIdx, selectedState);
+                }
+                if (nodeChildSize(arena, selectedIdx) == 0)
+                {
+                    if (MCTS_SOLVER && (nodeFlags(arena, selectedIdx) & NODE_EXPANDED))
+                    {
+                        markTerminal(arena, selectedIdx, selectedState);
+                        stats->nodesSolved++;
+                    }
+                    break;
+                }
+            }
+            selectedIdx = selectChild(arena, selectedIdx);
+            int position = nodePosition(arena, selectedIdx);
+            if (position < 0)
+            {
+                selectedState = resolvePosition(arena, &pendingPosition, selectedState, &scratch);
+                selectedState = descendToChild(arena, selectedIdx, selectedState, &scratch);
+            }
+            pendingPosition = position;
+            path[depth++] = selectedIdx;
+            if (virtualLoss)
+                addVirtualLoss(arena, selectedIdx);
+        }
+        selectedState = resolvePosition(arena, &pendingPosition, selectedState, &scratch);
+
+        bool blackEval = (nodeFlags(arena, selectedIdx) & NODE_BLACK_MOVED) != 0;
+        unsigned short solved = MCTS_SOLVER ? nodeFlags(arena, selectedIdx) & NODE_SOLVED : 0;
+        float reward = 0;
+        if (amaf != nullptr)
+            amaf->numOfRollouts = 0;
+        if (solved)
+            reward = getSolvedReward(solved);
+        else if (isHostPlayer(player))
+            hostMakeEvaluation(arena, selectedIdx, selectedState, blackEval, player, random, cache, budget, timeStamps, stats, reward, amaf);
+#ifdef __CUDACC__
+        else
+            if (!deviceMakeEvaluation(arena, selectedIdx, selectedState, blackEval, player, d_rewards, d_fixed, d_rolloutStats, d_amaf, cache, budget, timeStamps, stats, reward, amaf)) break;
+#endif
+#if RAVE
+        updateAmaf(arena, path, depth, blackEval, reward, amaf);
+#endif
+
+        // reward is added from perspective of player who moved into each node on path,
+        // path is followed instead of parents as shared children have only one of them,
+        // result of solved leaf is propagated up as long as it proves result of next node
+        bool solving = solved != 0;
+        for (int i = depth - 1; i >= 0; i--)
+        {
+            int prevIdx = path[i];
+            if (solving && i < depth - 1)
+            {
+                bool wasSolved = (nodeFlags(arena, prevIdx) & NODE_SOLVED) != 0;
+                solving = solveNode(arena, prevIdx);
+                if (solving && !wasSolved)
+                    stats->nodesSolved++;
+            }
+            nodeChunk* chunk = getChunk(arena, prevIdx);
+            int offset = NODE_OFFSET(prevIdx);
+            chunk->visits[offset] += 1 - lossVisits;
+            addReward(chunk->rewardSum[offset], (((chunk->flags[offset] & NODE_BLACK_MOVED) != 0) == blackEval ? reward : -reward)
+                + lossVisits * VIRTUAL_LOSS_REWARD);
         }
-        if (numOfWhite != numOfBlack)
-            sumRewards += evaluatePositionValue(copyNode->rows, copyNode->cols, copyNode->isQueen, blackEval);
-        freeNode(copyNode);
-        delete[] pawnHasKill;
-        delete[] available;
     }
-    root->avgReward = sumRewards / (float)(player == PLAYER_ONE ? NUM_OF_EVAL_ONE : NUM_OF_EVAL_TWO);
-    auto cpuEnd = std::chrono::high_resolution_clock::now();
-    timeStamps[2] += cpuEnd - cpuStart;
+    if (MCTS_SOLVER && (nodeFlags(arena, rootIdx) & NODE_SOLVED))
+    {
+        budget->solved = true;
+        budget->stopped = true;
+    }
+}
+
+// grows tree shared with other threads, run on separate thread
+void runTreeWorker(nodeArena* arena, int rootIdx, int player, searchBudget* budget, unsigned long long seed, evalCache* cache, std::chrono::nanoseconds* timeStamps, searchStats* stats)
+{
+    hostRandom random = { seed };
+    runSearch(arena, rootIdx, player, budget, true, random, nullptr, nullptr, nullptr, nullptr, cache, timeStamps, stats);
+}
+
+// grows main tree of player, shared by TREE_PARALLEL_THREADS threads when simulations are run on host
+void runSharedSearch(nodeArena* arena, int rootIdx, int player, searchBudget* budget, float* d_rewards, fixedNode* d_fixed, rolloutStats* d_rolloutStats, amafStats* d_amaf, evalCache* cache, std::chrono::nanoseconds* timeStamps, searchStats* stats)
+{
+    hostRandom random = { (unsigned long long)rand() };
+    int numOfThreads = getTreeThreads(player);
+    if (numOfThreads == 1)
+    {
+        runSearch(arena, rootIdx, player, budget, false, random, d_rewards, d_fixed, d_rolloutStats, d_amaf, cache, timeStamps, stats);
+        return;
+    }
+
+    // rest of iterations is held back while this thread runs calibration alone,
+    // iteration failing to be taken leaves budget below zero
+    int reserved = budget->iterations - min(PARALLEL_CALIBRATION_ITERATIONS, budget->iterations / 4);
+    budget->iterations -= reserved;
+    long long iterationsStart = stats->iterations;
+    auto calibrationStart = std::chrono::high_resolution_clock::now();
+    runSearch(arena, rootIdx, player, budget, true, random, d_rewards, d_fixed, d_rolloutStats, d_amaf, cache, timeStamps, stats);
+    auto calibrationEnd = std::chrono::high_resolution_clock::now();
+    long long calibrationIterations = stats->iterations - iterationsStart;
+    budget->iterations = max((int)budget->iterations, 0) + reserved;
+    // other limits are checked again by threads
+    budget->stopped = budget->solved.load();
+
+    int numOfWorkers = numOfThreads - 1;
+    std::thread* threads = new std::thread[numOfWorkers];
+    std::chrono::nanoseconds(*workerTimeStamps)[3] = new std::chrono::nanoseconds[numOfWorkers][3];
+    searchStats* workerStats = new searchStats[numOfWorkers];
+    for (int i = 0; i < numOfWorkers; i++)
+    {
+        workerTimeStamps[i][2] = std::chrono::nanoseconds(0);
+        workerStats[i] = {};
+        threads[i] = std::thread(runTreeWorker, arena, rootIdx, player, budget, (unsigned long long)rand(), cache, workerTimeStamps[i], &workerStats[i]);
+    }
+    runSearch(arena, rootIdx, player, budget, true, random, d_rewards, d_fixed, d_rolloutStats, d_amaf, cache, timeStamps, stats);
+    for (int i = 0; i < numOfWorkers; i++)
+    {
+        threads[i].join();
+        mergeSearchStats(stats, &workerStats[i]);
+        timeStamps[2] += workerTimeStamps[i][2];
+    }
+    auto parallelEnd = std::chrono::high_resolution_clock::now();
+    long long parallelIterations = stats->iterations - iterationsStart - calibrationIterations;
+    if (calibrationIterations > 0 && parallelIterations > 0)
+        stats->parallelEfficiency = (parallelIterations / (double)(parallelEnd - calibrationEnd).count())
+            / (numOfThreads * calibrationIterations / (double)(calibrationEnd - calibrationStart).count());
+    delete[] threads;
+    delete[] workerTimeStamps;
+    delete[] workerStats;
+}
+
+// grows tree independent of main one from copy of root game state, run on separate thread
+void runRootWorker(nodeArena* arena, node* rootState, int player, std::chrono::high_resolution_clock::time_point start, searchBudget* shared, unsigned long long seed, evalCache* cache, std::chrono::nanoseconds* timeStamps, searchStats* stats, int* rootIdx)
+{
+    resetArena(arena);
+    *rootIdx = initRoot(arena, rootState->fields, rootState->rows, rootState->cols, rootState->isQueen, rootState->blackTurn);
+    if (*rootIdx < 0)
+        return;
+    expandNode(arena, *rootIdx, rootState);
+    if (nodeChildSize(arena, *rootIdx) == 0)
+        return;
+    hostRandom random = { seed };
+    // limits other than deadline and solved root of main tree apply to each tree on its own
+    searchBudget budget;
+    initSearchBudget(&budget, player, arena, start);
+    budget.shared = shared;
+    runSearch(arena, *rootIdx, player, &budget, false, random, nullptr, nullptr, nullptr, nullptr, cache, timeStamps, stats);
+}
+
+// grows tree of player from rootIdx until pondering is stopped, run on separate thread
+void runPonder(searchTree* tree, int rootIdx, int player, evalCache* cache)
+{
+    float* d_rewards = nullptr;
+    fixedNode* d_fixed = nullptr;
+    rolloutStats* d_rolloutStats = nullptr;
+    amafStats* d_amaf = nullptr;
+#ifdef __CUDACC__
+    if (player == PLAYER_ONE && PARALLEL_PLAYER_ONE)
+    {
+        if (!d_initMemory(&d_rewards, &d_fixed, &d_rolloutStats, &d_amaf, BLOCK_NUM_ONE)) return;
+    }
+    else if (player == PLAYER_TWO && PARALLEL_PLAYER_TWO)
+    {
+        if (!d_initMemory(&d_rewards, &d_fixed, &d_rolloutStats, &d_amaf, BLOCK_NUM_TWO)) return;
+    }
+#endif
+    std::chrono::nanoseconds timeStamps[3] = {};
+    runSharedSearch(tree->arena, rootIdx, player, &tree->ponderBudget, d_rewards, d_fixed, d_rolloutStats, d_amaf, cache, timeStamps, &tree->ponderStats);
+#ifdef __CUDACC__
+    d_freeMemory(d_rewards, d_fixed, d_rolloutStats, d_amaf);
+#endif
+}
+
+// compacts tree to subtree of last move of player and grows it while opponent is thinking, run on separate thread
+void runBackgroundWork(searchTree* tree, int player, evalCache* cache)
+{
+    compactTree(tree, player);
+    int rootIdx = tree->lastMove;
+    if (!PONDER || rootIdx < 0)
+        return;
+    nodeArena* arena = tree->arena;
+    node rootState;
+    if (nodeChildSize(arena, rootIdx) == 0)
+        expandNode(arena, rootIdx, loadPosition(arena, nodePosition(arena, rootIdx), &rootState));
+    if (nodeChildSize(arena, rootIdx) == 0)
+        return;
+    for (int i = 0; i < nodeChildSize(arena, rootIdx); i++)
+        tree->ponderStartVisits[i] = nodeVisits(arena, nodeFirstChild(arena, rootIdx) + i);
+    tree->ponderRoot = rootIdx;
+    tree->ponderBudget.nodesStart = arena->size;
+    runPonder(tree, rootIdx, player, cache);
+}
+
+// starts work on tree of player after its move so that move is returned without waiting for it,
+// budget of pondering is set up here so that stopping it can't be missed by thread
+void startBackgroundWork(searchTree* tree, int player, evalCache* cache)
+{
+    tree->ponderStats = {};
+    tree->ponderRoot = -1;
+    if (tree->lastMove < 0)
+        return;
+    initSearchBudget(&tree->ponderBudget, player, tree->arena, std::chrono::high_resolution_clock::now());
+    tree->ponderBudget.iterations = INT_MAX;
+    tree->ponderBudget.hasDeadline = false;
+    tree->ponderBudget.maxNodes = PONDER_MAX_NODES;
+    tree->ponderBudget.maxSimulations = 0;
+    tree->backgroundThread = std::thread(runBackgroundWork, tree, player, cache);
 }
 
 // finds best move with MCTS tree and performs it on data structures
-bool makeMCTSMove(int* fields, int* rows, int* cols, bool* isQueen, bool blackTurn, int player, std::chrono::nanoseconds* timeStamps)
+bool makeMCTSMove(int* fields, int* rows, int* cols, bool* isQueen, bool blackTurn, int player, searchTree* tree, evalCache* cache, std::chrono::nanoseconds* timeStamps, searchStats* stats)
 {
-    node* root = initNode(fields, rows, cols, isQueen, blackTurn);
-    root->parent = nullptr;
-    expandNode(root);
+    // time limit of move covers reuse of tree and allocation of device memory too
+    auto moveStart = std::chrono::high_resolution_clock::now();
+    stopBackgroundWork(tree);
+    int rootIdx = reuseSubtree(tree, fields, isQueen, blackTurn, canReleaseNodes(player));
+    nodeArena* arena = tree->arena;
+    if (rootIdx < 0 || nodePosition(arena, rootIdx) < 0)
+    {
+        resetArena(arena);
+        tree->visitsPondered = 0;
+        rootIdx = initRoot(arena, fields, rows, cols, isQueen, blackTurn);
+        if (rootIdx < 0)
+            return false;
+    }
+    stats->visitsReused = nodeVisits(arena, rootIdx);
+    node rootState;
+    node* root = loadPosition(arena, nodePosition(arena, rootIdx), &rootState);
+    if (nodeChildSize(arena, rootIdx) == 0 && !expandNode(arena, rootIdx, root))
+    {
+        // reused subtree filled arena, search starts over
+        resetArena(arena);
+        rootIdx = initRoot(arena, fields, rows, cols, isQueen, blackTurn);
+        if (rootIdx < 0)
+            return false;
+        stats->visitsReused = 0;
+        tree->visitsPondered = 0;
+        loadPosition(arena, nodePosition(arena, rootIdx), root);
+        expandNode(arena, rootIdx, root);
+    }
 
-    if (root->childSize == 0)
+    if (nodeChildSize(arena, rootIdx) == 0)
+    {
+        resetArena(arena);
         return false;
+    }
 
 
     timeStamps[0] = std::chrono::nanoseconds(0);
     timeStamps[1] = std::chrono::nanoseconds(0);
     timeStamps[2] = std::chrono::nanoseconds(0);
+    stats->simulations = 0;
+    stats->simulationsSaved = 0;
+    stats->cacheHits = 0;
+    stats->simulationsReused = 0;
+    stats->transpositionsLinked = 0;
+    stats->iterations = 0;
+    stats->iterationsPondered = tree->ponderStats.iterations;
+    stats->nodesRecycled = 0;
+    stats->nodesSolved = 0;
+    stats->parallelEfficiency = 0;
+    stats->rollouts = {};
 
     auto gpuMemAllocStart = std::chrono::high_resolution_clock::now();
     float* d_rewards = nullptr;
-    fixedNode* d_fixed;
+    fixedNode* d_fixed = nullptr;
+    rolloutStats* d_rolloutStats = nullptr;
+    amafStats* d_amaf = nullptr;
+#ifdef __CUDACC__
     if (player == PLAYER_ONE && PARALLEL_PLAYER_ONE)
     {
-        d_initMemory(&d_rewards, &d_fixed, BLOCK_NUM_ONE);
+        d_initMemory(&d_rewards, &d_fixed, &d_rolloutStats, &d_amaf, BLOCK_NUM_ONE);
     }
     else if (player == PLAYER_TWO && PARALLEL_PLAYER_TWO)
     {
-        d_initMemory(&d_rewards, &d_fixed, BLOCK_NUM_TWO);
+        d_initMemory(&d_rewards, &d_fixed, &d_rolloutStats, &d_amaf, BLOCK_NUM_TWO);
     }
+#endif
     auto gpuMemAllocEnd = std::chrono::high_resolution_clock::now();
     timeStamps[1] = gpuMemAllocEnd - gpuMemAllocStart;
 
-    for (int p = 0; p < (player == PLAYER_ONE ? TREE_ITER_ONE : TREE_ITER_TWO); p++)
+    auto searchStart = std::chrono::high_resolution_clock::now();
+    searchBudget budget;
+    initSearchBudget(&budget, player, arena, moveStart);
+    budget.iterations -= min(tree->visitsPondered, (int)budget.iterations);
+    if (isHostPlayer(player) && tree->numOfWorkers > 0)
     {
-
-        node* selectedChild = root;
-        do {
-            float maxUCB = getUCBValue(selectedChild, selectedChild->childs[0]);
-            int idxWithBiggestUCB = 0;
-            float handlerUCB = 0;
-            for (int i = 1; i < selectedChild->childSize; i++)
-                if ((handlerUCB = getUCBValue(selectedChild, selectedChild->childs[i])) > maxUCB)
-                {
-                    maxUCB = handlerUCB;
-                    idxWithBiggestUCB = i;
-                }
-            selectedChild = selectedChild->childs[idxWithBiggestUCB];
-        } while (selectedChild->childSize != 0);
-
-        if (selectedChild->howManyVisits == 0)
+        std::thread* threads = new std::thread[tree->numOfWorkers];
+        std::chrono::nanoseconds(*workerTimeStamps)[3] = new std::chrono::nanoseconds[tree->numOfWorkers][3];
+        searchStats* workerStats = new searchStats[tree->numOfWorkers];
+        int* workerRoots = new int[tree->numOfWorkers];
+        for (int i = 0; i < tree->numOfWorkers; i++)
         {
-            if ((player == PLAYER_ONE && !PARALLEL_PLAYER_ONE) || (player == PLAYER_TWO && !PARALLEL_PLAYER_TWO))
-                hostMakeEvaluation(selectedChild, blackTurn, player, timeStamps);
-            else
-                if (!deviceMakeEvaluation(selectedChild, blackTurn, player, d_rewards, d_fixed, timeStamps)) break;
-
-            node* prev = selectedChild->parent;
-            while (prev != nullptr)
-            {
-                prev->avgReward = 0;
-                for (int i = 0; i < prev->childSize; i++)
-                    prev->avgReward += prev->childs[i]->avgReward;
-                prev->avgReward /= prev->childSize;
-                prev->howManyVisits = prev->howManyVisits + 1;
-                prev = prev->parent;
-            }
+            workerTimeStamps[i][2] = std::chrono::nanoseconds(0);
+            workerStats[i] = {};
+            threads[i] = std::thread(runRootWorker, tree->workers[i], root, player, moveStart, &budget, (unsigned long long)rand(), cache, workerTimeStamps[i], &workerStats[i], &workerRoots[i]);
         }
-        else
+        runSharedSearch(arena, rootIdx, player, &budget, d_rewards, d_fixed, d_rolloutStats, d_amaf, cache, timeStamps, stats);
+        for (int i = 0; i < tree->numOfWorkers; i++)
         {
-            expandNode(selectedChild);
+            threads[i].join();
+            mergeRootStats(arena, rootIdx, tree->workers[i], workerRoots[i]);
+            mergeSearchStats(stats, &workerStats[i]);
+            timeStamps[2] += workerTimeStamps[i][2];
         }
-        selectedChild->howManyVisits = selectedChild->howManyVisits + 1;
+        delete[] threads;
+        delete[] workerTimeStamps;
+        delete[] workerStats;
+        delete[] workerRoots;
     }
-
+    else
+    {
+        runSharedSearch(arena, rootIdx, player, &budget, d_rewards, d_fixed, d_rolloutStats, d_amaf, cache, timeStamps, stats);
+    }
+    auto searchEnd = std::chrono::high_resolution_clock::now();
+    int numOfThreads = getTreeThreads(player) + (isHostPlayer(player) ? tree->numOfWorkers : 0);
+    stats->threadUtilization = (double)(timeStamps[0] + timeStamps[2]).count() / ((searchEnd - searchStart).count() * (double)numOfThreads);
+    stats->searchTime = std::chrono::duration_cast<std::chrono::microseconds>(searchEnd - searchStart).count();
+    stats->treeBytes = treeBytes(arena);
+    if (isHostPlayer(player))
+        for (int i = 0; i < tree->numOfWorkers; i++)
+            stats->treeBytes += treeBytes(tree->workers[i]);
+    stats->peakTreeBytes = tree->memory.peakBytes;
+
+    node scratch;
+    int selectedIdx = rootIdx;
     node* selectedMove = root;
     do {
-        float resultReward = selectedMove->childs[0]->avgReward;
+        int firstChild = nodeFirstChild(arena, selectedIdx);
+        float resultReward = getMoveValue(arena, firstChild);
         float resultHandler = 0;
         int resultIdx = 0;
 
-        for (int i = 1; i < selectedMove->childSize; i++)
-            if ((resultHandler = selectedMove->childs[i]->avgReward) > resultReward)
+        for (int i = 1; i < nodeChildSize(arena, selectedIdx); i++)
+            if ((resultHandler = getMoveValue(arena, firstChild + i)) > resultReward)
             {
                 resultReward = resultHandler;
                 resultIdx = i;
             }
 
-        selectedMove = selectedMove->childs[resultIdx];
-    } while (selectedMove->lastKill >= 0 && selectedMove->childSize > 0);
+        selectedIdx = firstChild + resultIdx;
+        selectedMove = descendToChild(arena, selectedIdx, selectedMove, &scratch);
+    } while (selectedMove->lastKill >= 0 && nodeChildSize(arena, selectedIdx) > 0);
 
     // this shouldn't ever happen if tree is at least with few levels
-    if (selectedMove->lastKill >= 0)
+    bool randomChainEnd = selectedMove->lastKill >= 0;
+    if (randomChainEnd)
     {
         bool* pawnHasKill = new bool[PAWN_ROWS * BOARD_SIZE];
         bool* available = new bool[BOARD_SIZE * BOARD_SIZE];
-        bool* isQueen = new bool[PAWN_ROWS * BOARD_SIZE];
         int numOfWhite = 0, numOfBlack = 0;
         for (int i = 0; i < PAWN_ROWS * BOARD_SIZE / 2; i++)
             if (selectedMove->rows[i] >= 0) numOfWhite++;
         for (int i = PAWN_ROWS * BOARD_SIZE / 2; i < PAWN_ROWS * BOARD_SIZE; i++)
             if (selectedMove->rows[i] >= 0) numOfBlack++;
-        h_makeRandomAvailableMove(selectedMove->fields, selectedMove->rows, selectedMove->cols, pawnHasKill, isQueen, selectedMove->blackTurn, available, numOfWhite, numOfBlack, selectedMove->lastKill);
+        hostRandom random = { (unsigned long long)rand() };
+        makeRandomAvailableMove(selectedMove->fields, selectedMove->rows, selectedMove->cols, pawnHasKill, selectedMove->isQueen, selectedMove->blackTurn, available, numOfWhite, numOfBlack, random, selectedMove->lastKill);
         delete[] pawnHasKill;
         delete[] available;
-        delete[] isQueen;
     }
     for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
     {
@@ -1925,14 +4178,46 @@ bool makeMCTSMove(int* fields, int* rows, int* cols, bool* isQueen, bool blackTu
         cols[i] = selectedMove->cols[i];
         isQueen[i] = selectedMove->isQueen[i];
     }
-    d_freeMemory(d_rewards, d_fixed);
-    freeNode(root);
+#ifdef __CUDACC__
+    d_freeMemory(d_rewards, d_fixed, d_rolloutStats, d_amaf);
+#endif
+    if (!randomChainEnd)
+    {
+        if (nodePosition(arena, selectedIdx) < 0)
+            nodePosition(arena, selectedIdx) = storePosition(arena, selectedMove);
+        if (nodePosition(arena, selectedIdx) >= 0)
+            tree->lastMove = selectedIdx;
+    }
+    startBackgroundWork(tree, player, cache);
 
     return true;
 }
 
+// prints rollout statistics of move to file
+void printOutRolloutStats(std::chrono::nanoseconds* timeStamps, searchStats* stats, int blackTurn)
+{
+    string outputFile = "rollouts.txt";
+    ofstream output;
+    output.open(outputFile, ios::app);
+
+    rolloutStats* rollouts = &stats->rollouts;
+    auto evaluationTime = std::chrono::duration_cast<std::chrono::microseconds>(timeStamps[0] + timeStamps[2]).count();
+    double pliesPerSecond = evaluationTime > 0 ? rollouts->plies * 1000000.0 / evaluationTime : 0;
+    double avgLength = rollouts->rollouts > 0 ? rollouts->plies / (double)rollouts->rollouts : 0;
+    double avgCaptures = rollouts->rollouts > 0 ? rollouts->captures / (double)rollouts->rollouts : 0;
+
+    output << blackTurn << " " << rollouts->rollouts << " " << avgLength << " "
+        << avgCaptures << " " << (long long)pliesPerSecond;
+    for (int i = 0; i < ROLLOUT_END_REASONS; i++)
+        output << " " << rollouts->endReasons[i];
+    for (int i = 0; i <= MAX_MOVES; i++)
+        output << " " << rollouts->lengthHistogram[i];
+    output << endl;
+    output.close();
+}
+
 // prints logs to file
-void printOutTimes(std::chrono::nanoseconds* timeStamps, int blackTurn)
+void printOutTimes(std::chrono::nanoseconds* timeStamps, searchStats* stats, int blackTurn)
 {
     string outputFile = "output.txt";
     ofstream output;
@@ -1945,8 +4230,18 @@ void printOutTimes(std::chrono::nanoseconds* timeStamps, int blackTurn)
     output << blackTurn << " " << MAX_MOVES << " "
         << TREE_ITER_ONE << " " << TREE_ITER_TWO << " "
         << NUM_OF_EVAL_ONE << " " << NUM_OF_EVAL_TWO << " "
-        << deviceTime << " " << deviceMemoryTime << " " << cpuTime << endl;
+        << deviceTime << " " << deviceMemoryTime << " " << cpuTime << " "
+        << stats->simulations << " " << stats->simulationsSaved << " "
+        << stats->cacheHits << " " << stats->simulationsReused << " "
+        << stats->visitsReused << " " << stats->transpositionsLinked << " "
+        << stats->threadUtilization << " " << stats->iterations << " "
+        << stats->searchTime << " " << stats->iterationsPondered << " "
+        << stats->treeBytes << " " << stats->peakTreeBytes << " " << stats->nodesRecycled << " "
+        << stats->nodesSolved << " " << stats->parallelEfficiency << endl;
     output.close();
+#if ROLLOUT_STATS
+    printOutRolloutStats(timeStamps, stats, blackTurn);
+#endif
 }
 
 int main()
@@ -1974,11 +4269,42 @@ int main()
     // 0 is for device time
     // 1 is for device memory operations
     // 2 is for cpu time
+    searchStats stats;
+    evalCache* cache = initEvalCache();
+    searchTree* trees[2] = { initSearchTree(), initSearchTree() };
 
     window.setFramerateLimit(25);
     Event event;
     int numOfAvailable = 0;
     bool isThereKill = false;
+    // engine whose tree is saved when window is closed mid game
+    int lastPlayer = 0;
+    bool closed = false;
+#if TREE_SNAPSHOT
+    for (int player = PLAYER_ONE; player <= PLAYER_TWO && lastPlayer == 0; player++)
+        if (loadSearchTree(trees[player - 1], player, TREE_SNAPSHOT_FILE))
+        {
+            lastPlayer = player;
+            getLastMovePosition(trees[player - 1], fields, rows, cols, isQueen, &blackTurn);
+            startBackgroundWork(trees[player - 1], player, cache);
+            for (int i = 0; i < PAWN_ROWS * BOARD_SIZE; i++)
+            {
+                if (rows[i] >= 0)
+                    setPawnPosition(pawns[i], rows[i], cols[i]);
+                else
+                    pawns[i].setRadius(0);
+                if (isQueen[i]) markQueen(pawns, i);
+            }
+            int firstPawn = blackTurn ? PAWN_ROWS * BOARD_SIZE / 2 : 0;
+            for (int i = firstPawn; i < firstPawn + PAWN_ROWS * BOARD_SIZE / 2; i++)
+            {
+                pawnHasKill[i] = rows[i] >= 0 && (isQueen[i] ? hasQueenKill(fields, rows[i],
+                    cols[i], i) : hasKill(fields, i, rows, cols));
+                if (pawnHasKill[i])
+                    isThereKill = true;
+            }
+        }
+#endif
 
     while (true)
     {
@@ -1987,6 +4313,7 @@ int main()
         if (event.type == Event::Closed)
         {
             window.close();
+            closed = true;
             break;
         }
 
@@ -1995,8 +4322,9 @@ int main()
             if (blackTurn)
             {
 
-                if (!makeMCTSMove(fields, rows, cols, isQueen, blackTurn, PLAYER_TWO, timeStamps)) break;
-                printOutTimes(timeStamps, blackTurn);
+                if (!makeMCTSMove(fields, rows, cols, isQueen, blackTurn, PLAYER_TWO, trees[PLAYER_TWO - 1], cache, timeStamps, &stats)) break;
+                lastPlayer = PLAYER_TWO;
+                printOutTimes(timeStamps, &stats, blackTurn);
                 blackTurn = !blackTurn;
                 for (int i = 0; i < PAWN_ROWS * BOARD_SIZE; i++)
                 {
@@ -2128,8 +4456,11 @@ int main()
         }
         else if (PLAYER_VS_AI == 0)
         {
-            if (!makeMCTSMove(fields, rows, cols, isQueen, blackTurn, blackTurn ? PLAYER_TWO : PLAYER_ONE, timeStamps)) break;
-            printOutTimes(timeStamps, blackTurn);
+            // engine pondering during sleep doesn't take resources of the one to move
+            stopBackgroundWork(trees[blackTurn ? PLAYER_ONE - 1 : PLAYER_TWO - 1]);
+            if (!makeMCTSMove(fields, rows, cols, isQueen, blackTurn, blackTurn ? PLAYER_TWO : PLAYER_ONE, trees[blackTurn ? PLAYER_TWO - 1 : PLAYER_ONE - 1], cache, timeStamps, &stats)) break;
+            lastPlayer = blackTurn ? PLAYER_TWO : PLAYER_ONE;
+            printOutTimes(timeStamps, &stats, blackTurn);
             Time t = sf::seconds(1);
             sleep(t);
             blackTurn = !blackTurn;
@@ -2163,8 +4494,21 @@ int main()
 
         window.display();
     }
+#if TREE_SNAPSHOT
+    // finished game or human move after last one of engine leaves nothing to resume, stale file is removed
+    // once trees don't map it
+    bool saved = closed && lastPlayer > 0
+        && saveSearchTree(trees[lastPlayer - 1], lastPlayer, fields, isQueen, blackTurn, TREE_SNAPSHOT_FILE);
+#endif
     delete[] fields;
     delete[] pawns;
+    freeEvalCache(cache);
+    freeSearchTree(trees[0]);
+    freeSearchTree(trees[1]);
+#if TREE_SNAPSHOT
+    if (!saved)
+        remove(TREE_SNAPSHOT_FILE);
+#endif
     return 0;
 }
 